@@ -0,0 +1,126 @@
+#include "AiWorker.h"
+#include "Engine.h"
+#include "kreversigame.h"
+
+#include <KDebug>
+
+
+AiWorker::AiWorker(const KReversiGame* game, QObject* parent)
+    : QThread(parent), m_game(game), m_engine(new Engine(1)), m_strength(1),
+      m_request(-1), m_pending(-1), m_pending_competitive(true),
+      m_pending_ponder(false), m_next_request(0), m_pondering(false), m_ai(0),
+      m_cancelled(false)
+{
+  // finished() is emitted in the worker thread, so this is a queued
+  // connection, and the move is reported in the thread of the worker.
+  connect(this, SIGNAL(finished()), SLOT(slotFinished()));
+}
+
+
+AiWorker::~AiWorker()
+{
+  m_cancelled = true;
+  wait();
+  delete m_engine;
+}
+
+
+int AiWorker::computeMove(bool competitive)
+{
+  int request = m_next_request++;
+
+  if (m_request >= 0) {
+    // Let the search that is running stop first.
+    m_cancelled           = true;
+    m_pending             = request;
+    m_pending_competitive = competitive;
+    m_pending_ponder      = false;
+  }
+  else
+    StartRequest(request, competitive, false);
+
+  return request;
+}
+
+
+void AiWorker::ponder()
+{
+  if (m_request < 0)
+    StartRequest(m_next_request++, true, true);
+  else if (m_cancelled && m_pending < 0) {
+    m_pending             = m_next_request++;
+    m_pending_competitive = true;
+    m_pending_ponder      = true;
+  }
+}
+
+
+void AiWorker::cancel()
+{
+  if (m_request >= 0)
+    m_cancelled = true;
+  m_pending = -1;
+}
+
+
+// Set up the engine for the position of the game and start searching it.
+// The worker thread is not running, so the engine and the Ai may be
+// touched here.
+//
+
+void AiWorker::StartRequest(int request, bool competitive, bool ponder)
+{
+  ChipColor   color = m_game->currentPlayer();
+  std::string game_state;
+
+  for (int row = 0; row < 8; row++)
+    for (int col = 0; col < 8; col++)
+      game_state.push_back(Engine::chipColor2Char(m_game->chipColorAt(row, col)));
+  game_state.push_back(Engine::chipColor2Char(color));
+
+  m_engine->setGameState(game_state);
+  m_engine->setCompetitive(competitive);
+  m_engine->setStrength(m_strength);
+
+  m_ai = m_game->getAi(ponder ? opponentColorFor(color) : color);
+  m_ai->setCancelFlag(&m_cancelled);
+
+  m_request   = request;
+  m_pondering = ponder;
+  m_cancelled = false;
+
+  if (ponder)
+    kDebug() << "----------AI" << opponentColorFor(color) << " is Pondering-----------------------";
+  else
+    kDebug() << "----------AI" << color << " is Thinking-------------------------";
+  start();
+}
+
+
+void AiWorker::run()
+{
+  if (m_pondering)
+    m_ai->ponder(*m_engine);
+  else
+    m_move = m_ai->selectMove(*m_engine);
+}
+
+
+void AiWorker::slotFinished()
+{
+  int  request  = m_request;
+  bool reported = !m_cancelled && !m_pondering;
+
+  m_request = -1;
+  if (m_pending >= 0) {
+    int pending = m_pending;
+    m_pending = -1;
+    StartRequest(pending, m_pending_competitive, m_pending_ponder);
+  }
+
+  if (reported)
+    emit moveComputed(request, m_move);
+}
+
+
+#include "AiWorker.moc"
@@ -0,0 +1,82 @@
+#ifndef KREVERSI_AIWORKER_H
+#define KREVERSI_AIWORKER_H
+
+#include <QThread>
+
+#include "commondefs.h"
+
+class Ai;
+class Engine;
+class KReversiGame;
+
+// An AiWorker computes the moves of the computer, and hints, for a
+// KReversiGame in a thread of its own.  The GUI thread never waits for a
+// search, so it never has to run the event loop from inside one, and
+// events cannot reach the game while it is in the middle of a move.
+//
+// computeMove() starts a request and returns at once with an id for it.
+// When the move is found, moveComputed() is emitted with that id in the
+// thread the worker belongs to (the GUI thread), where the game may
+// safely make the move.  A request is cancelled by cancel() or by the
+// next request: its search stops as soon as it notices, and its move is
+// never reported.  There is only one search at a time, so a new request
+// waits until a cancelled one has stopped.
+//
+// While the human thinks, ponder() lets the Ai of the computer search
+// the position too (if its profile ponders, see Ai::ponder()).  Nothing
+// is reported; the next request cancels it and finds its work done.
+
+class AiWorker : public QThread
+{
+  Q_OBJECT
+
+public:
+  explicit AiWorker(const KReversiGame* game, QObject* parent = 0);
+  ~AiWorker();
+
+  void  setStrength(uint strength) { m_strength = strength; }
+
+  // Start computing a move for the side to move in the game, with the Ai
+  // of that side.  The position is read from the game when the search
+  // starts.  Returns the id of the request.
+  int   computeMove(bool competitive);
+
+  // Start pondering the position of the game for the Ai of the side
+  // that is not to move.  Does nothing while a request is being
+  // searched, since the game is not waiting for the human then.
+  void  ponder();
+
+  // Cancel the running and the waiting request, if there are any.
+  void  cancel();
+
+signals:
+  void  moveComputed(int request, const KReversiPos& move);
+
+protected:
+  void  run();
+
+private slots:
+  void  slotFinished();
+
+private:
+  void  StartRequest(int request, bool competitive, bool ponder);
+
+  const KReversiGame*  m_game;
+  Engine*              m_engine;
+  uint                 m_strength;
+
+  // The request being searched, or -1, and the one waiting for it to
+  // stop, or -1.
+  int            m_request;
+  int            m_pending;
+  bool           m_pending_competitive;
+  bool           m_pending_ponder;
+  int            m_next_request;
+  bool           m_pondering;   // m_request is a ponder() request
+
+  Ai*            m_ai;          // of the side m_request is for
+  volatile bool  m_cancelled;   // read by the search in the worker thread
+  KReversiPos    m_move;        // result of m_request
+};
+
+#endif
@@ -0,0 +1,322 @@
+#ifndef KREVERSI_BITBOARD_H
+#define KREVERSI_BITBOARD_H
+
+#include <QtGlobal>
+
+// On x86-64 with GCC or Clang, legalMoveBits() and flippedBits() have
+// AVX2 versions that work on 4 directions at once. Whether the CPU has
+// AVX2 is only known at run time, so they are compiled for it on their
+// own and picked per call; the portable versions are used everywhere
+// else, and also when KREVERSI_NO_SIMD is defined.
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__) \
+  && !defined(KREVERSI_NO_SIMD)
+#define KREVERSI_BITBOARD_AVX2
+#include <immintrin.h>
+#endif
+
+// Bitboard helpers used by the search in Engine.
+//
+// A position is held as two 64 bit masks, one for the pieces of the side
+// to move and one for the pieces of its opponent. Square (row, col), with
+// row and col in 0..7, is bit number row * 8 + col. Engine lays out the
+// masks built by ComputeOccupiedBits() the same way, so they can be fed to
+// these functions directly.
+//
+// Legal moves and turned pieces are found by shifting masks one square at
+// a time in each of the 8 directions, instead of walking the board square
+// by square. With AVX2, 4 directions are shifted at once in the 4 lanes of
+// a vector, each by its own amount, and the opposite 4 directions with
+// the same amounts the other way.
+
+// Everything but the A and H files. Used to keep horizontal and diagonal
+// shifts from wrapping around to the next row.
+static const quint64 BB_INNER_COLUMNS = Q_UINT64_C(0x7E7E7E7E7E7E7E7E);
+
+// Squares with a non-zero value in Engine::m_bc_board, grouped by value.
+static const quint64 BB_CORNERS        = Q_UINT64_C(0x8100000000000081); //  2
+static const quint64 BB_X_SQUARES      = Q_UINT64_C(0x0042000000004200); // -2
+static const quint64 BB_BAD_SQUARES    = Q_UINT64_C(0x42BD42424242BD42); // -1
+
+static inline int bitCount(quint64 bits)
+{
+#if defined(__GNUC__)
+  return __builtin_popcountll(bits);
+#else
+  int count = 0;
+  for (; bits; bits &= bits - 1)
+    count++;
+  return count;
+#endif
+}
+
+// Index of the lowest set bit. bits must not be 0.
+static inline int firstBit(quint64 bits)
+{
+#if defined(__GNUC__)
+  return __builtin_ctzll(bits);
+#else
+  int index = 0;
+  while (!(bits & 1)) {
+    bits >>= 1;
+    index++;
+  }
+  return index;
+#endif
+}
+
+static inline quint64 squareBit(int square)
+{
+  return Q_UINT64_C(1) << square;
+}
+
+// Order in which the searches try squares that nothing else tells apart,
+// by their distance to the edges (min(row, 7-row), min(col, 7-col)):
+// corners first, then the other edge squares, the inner squares, and
+// finally the squares next to corners.
+static const int BB_SQUARE_PRIORITIES = 10;
+static const int BB_SQUARE_PRIORITY[4][4] = {
+  { 0, 8, 1, 2 },
+  { 8, 9, 6, 7 },
+  { 1, 6, 3, 4 },
+  { 2, 7, 4, 5 }
+};
+
+static inline int squarePriority(int square)
+{
+  int row = square / 8;
+  int col = square % 8;
+
+  return BB_SQUARE_PRIORITY[qMin(row, 7 - row)][qMin(col, 7 - col)];
+}
+
+// Shift all bits one step in a direction. Positive values shift towards
+// higher bit numbers.
+static inline quint64 shiftBits(quint64 bits, int shift)
+{
+  return shift > 0 ? bits << shift : bits >> -shift;
+}
+
+// The 8 directions as bit shifts, and the part of the opponent mask that
+// may be passed in each of them without wrapping around the board edge.
+static const int     BB_DIR_SHIFT[8] = { 1, -1, 8, -8, 7, -7, 9, -9 };
+static const quint64 BB_DIR_MASK[8]  = {
+  BB_INNER_COLUMNS, BB_INNER_COLUMNS,
+  ~Q_UINT64_C(0),   ~Q_UINT64_C(0),
+  BB_INNER_COLUMNS, BB_INNER_COLUMNS,
+  BB_INNER_COLUMNS, BB_INNER_COLUMNS
+};
+
+// Portable version of legalMoveBits(), below.
+static inline quint64 legalMoveBitsPortable(quint64 own, quint64 opp)
+{
+  quint64 empty = ~(own | opp);
+  quint64 moves = 0;
+
+  for (int dir = 0; dir < 8; dir++) {
+    int      shift = BB_DIR_SHIFT[dir];
+    quint64  mopp  = opp & BB_DIR_MASK[dir];
+
+    // Runs of opponent pieces are at most 6 long.
+    quint64 run = shiftBits(own, shift) & mopp;
+    run |= shiftBits(run, shift) & mopp;
+    run |= shiftBits(run, shift) & mopp;
+    run |= shiftBits(run, shift) & mopp;
+    run |= shiftBits(run, shift) & mopp;
+    run |= shiftBits(run, shift) & mopp;
+
+    moves |= shiftBits(run, shift) & empty;
+  }
+
+  return moves;
+}
+
+// Portable version of flippedBits(), below.
+static inline quint64 flippedBitsPortable(int square, quint64 own,
+					  quint64 opp)
+{
+  quint64 flipped = 0;
+  quint64 start   = squareBit(square);
+
+  for (int dir = 0; dir < 8; dir++) {
+    int      shift = BB_DIR_SHIFT[dir];
+    quint64  mopp  = opp & BB_DIR_MASK[dir];
+    quint64  run   = 0;
+    quint64  bit   = shiftBits(start, shift);
+
+    while (bit & mopp) {
+      run |= bit;
+      bit = shiftBits(bit, shift);
+    }
+
+    if (bit & own)
+      flipped |= run;
+  }
+
+  return flipped;
+}
+
+#ifdef KREVERSI_BITBOARD_AVX2
+
+// The shifts of 4 of the directions, one per lane, with the part of the
+// opponent mask that may be passed in them. Shifting the other way gives
+// the 4 opposite directions.
+#define BB_AVX2_SHIFTS  _mm256_set_epi64x(9, 7, 1, 8)
+#define BB_AVX2_MASKS   _mm256_set_epi64x(BB_INNER_COLUMNS, BB_INNER_COLUMNS, \
+					  BB_INNER_COLUMNS, ~Q_UINT64_C(0))
+
+// The or of the 4 lanes of a vector.
+__attribute__((target("avx2")))
+static inline quint64 orLanesAvx2(__m256i v)
+{
+  __m128i half = _mm_or_si128(_mm256_castsi256_si128(v),
+			      _mm256_extracti128_si256(v, 1));
+
+  return _mm_cvtsi128_si64(_mm_or_si128(half, _mm_unpackhi_epi64(half, half)));
+}
+
+// Same as legalMoveBitsPortable(). The runs are grown one square at a
+// time to 2, and then two squares at a time: pairs holds the opponent
+// pieces with another one right behind them.
+__attribute__((target("avx2")))
+static inline quint64 legalMoveBitsAvx2(quint64 own, quint64 opp)
+{
+  __m256i shift  = BB_AVX2_SHIFTS;
+  __m256i shift2 = _mm256_add_epi64(shift, shift);
+  __m256i vown   = _mm256_set1_epi64x(own);
+  __m256i mopp   = _mm256_and_si256(_mm256_set1_epi64x(opp), BB_AVX2_MASKS);
+
+  __m256i pairs_up   = _mm256_and_si256(mopp, _mm256_sllv_epi64(mopp, shift));
+  __m256i pairs_down = _mm256_srlv_epi64(pairs_up, shift);
+
+  __m256i up   = _mm256_and_si256(mopp, _mm256_sllv_epi64(vown, shift));
+  __m256i down = _mm256_and_si256(mopp, _mm256_srlv_epi64(vown, shift));
+  up   = _mm256_or_si256(up, _mm256_and_si256(mopp, _mm256_sllv_epi64(up, shift)));
+  down = _mm256_or_si256(down, _mm256_and_si256(mopp, _mm256_srlv_epi64(down, shift)));
+  for (int i = 0; i < 2; i++) {
+    up   = _mm256_or_si256(up, _mm256_and_si256(pairs_up,
+						_mm256_sllv_epi64(up, shift2)));
+    down = _mm256_or_si256(down, _mm256_and_si256(pairs_down,
+						  _mm256_srlv_epi64(down, shift2)));
+  }
+
+  __m256i moves = _mm256_or_si256(_mm256_sllv_epi64(up, shift),
+				  _mm256_srlv_epi64(down, shift));
+
+  return orLanesAvx2(moves) & ~(own | opp);
+}
+
+// Same as flippedBitsPortable(). The runs of opponent pieces from square
+// are grown in all directions, and kept in the lanes where an own piece
+// closes them.
+__attribute__((target("avx2")))
+static inline quint64 flippedBitsAvx2(int square, quint64 own, quint64 opp)
+{
+  __m256i shift = BB_AVX2_SHIFTS;
+  __m256i vown  = _mm256_set1_epi64x(own);
+  __m256i mopp  = _mm256_and_si256(_mm256_set1_epi64x(opp), BB_AVX2_MASKS);
+  __m256i start = _mm256_set1_epi64x(Q_UINT64_C(1) << square);
+
+  __m256i up   = _mm256_and_si256(mopp, _mm256_sllv_epi64(start, shift));
+  __m256i down = _mm256_and_si256(mopp, _mm256_srlv_epi64(start, shift));
+  for (int i = 0; i < 5; i++) {
+    up   = _mm256_or_si256(up, _mm256_and_si256(mopp, _mm256_sllv_epi64(up, shift)));
+    down = _mm256_or_si256(down, _mm256_and_si256(mopp, _mm256_srlv_epi64(down, shift)));
+  }
+
+  // All ones in the lanes where the square after the run is not own.
+  __m256i zero      = _mm256_setzero_si256();
+  __m256i open_up   = _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_sllv_epi64(up, shift),
+							 vown), zero);
+  __m256i open_down = _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_srlv_epi64(down, shift),
+							 vown), zero);
+
+  return orLanesAvx2(_mm256_or_si256(_mm256_andnot_si256(open_up, up),
+				     _mm256_andnot_si256(open_down, down)));
+}
+
+#undef BB_AVX2_SHIFTS
+#undef BB_AVX2_MASKS
+
+// True if the CPU has AVX2. The answer is cached by the compiler runtime,
+// so this is a load and a test.
+static inline bool bbHaveAvx2()
+{
+  return __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+// Return a mask of all legal moves for the side owning 'own'.
+static inline quint64 legalMoveBits(quint64 own, quint64 opp)
+{
+#ifdef KREVERSI_BITBOARD_AVX2
+  if (bbHaveAvx2())
+    return legalMoveBitsAvx2(own, opp);
+#endif
+  return legalMoveBitsPortable(own, opp);
+}
+
+// Return a mask of the opponent pieces that are turned if the side owning
+// 'own' plays at 'square'. A result of 0 means that the move is illegal.
+static inline quint64 flippedBits(int square, quint64 own, quint64 opp)
+{
+#ifdef KREVERSI_BITBOARD_AVX2
+  if (bbHaveAvx2())
+    return flippedBitsAvx2(square, own, opp);
+#endif
+  return flippedBitsPortable(square, own, opp);
+}
+
+// Return a mask of the squares next to a piece in 'bits', in any of the
+// 8 directions. The pieces themselves are only included if they are next
+// to another one.
+static inline quint64 adjacentBits(quint64 bits)
+{
+  // Keep the shifts towards the A and H files from wrapping around to
+  // the next row.
+  quint64 sides = ((bits << 1) & ~Q_UINT64_C(0x0101010101010101))
+    | ((bits >> 1) & ~Q_UINT64_C(0x8080808080808080));
+  quint64 row   = bits | sides;
+
+  return sides | (row << 8) | (row >> 8);
+}
+
+// Return a mask of the frontier of the pieces in 'bits': those next to an
+// empty square. Frontier pieces give the opponent moves, so fewer is
+// better.
+static inline quint64 frontierBits(quint64 bits, quint64 empty)
+{
+  return bits & adjacentBits(empty);
+}
+
+// Weights of the board control values, the mobility (number of legal
+// moves) and the frontier against the number of pieces in the evaluation
+// of a position.
+static const int BC_WEIGHT       = 3;
+static const int MOBILITY_WEIGHT = 1;
+static const int FRONTIER_WEIGHT = 1;
+
+// The sum of the board control values (see Engine::m_bc_board) of the
+// squares in 'bits'.
+static inline int bcScoreBits(quint64 bits)
+{
+  return 2 * bitCount(bits & BB_CORNERS)
+    - 2 * bitCount(bits & BB_X_SQUARES)
+    - bitCount(bits & BB_BAD_SQUARES);
+}
+
+// The part of the evaluation of a position that is weighted more the
+// earlier it is in the game: the board control values, the mobility and
+// the frontier of 'own' against those of 'opp'.
+static inline int positionalScoreBits(quint64 own, quint64 opp)
+{
+  quint64 empty = ~(own | opp);
+
+  return BC_WEIGHT * (bcScoreBits(own) - bcScoreBits(opp))
+    + MOBILITY_WEIGHT * (bitCount(legalMoveBits(own, opp))
+			 - bitCount(legalMoveBits(opp, own)))
+    - FRONTIER_WEIGHT * (bitCount(frontierBits(own, empty))
+			 - bitCount(frontierBits(opp, empty)));
+}
+
+#endif
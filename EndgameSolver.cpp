@@ -0,0 +1,600 @@
+#include "EndgameSolver.h"
+#include "Bitboard.h"
+#include "TranspositionTable.h"
+
+#include <QElapsedTimer>
+
+// Bounds of the final score.
+static const int SCORE_INF          = 65;
+
+// Below this number of empties the moves are tried in parity order,
+// above it fastest first.
+static const int PARITY_EMPTIES     = 5;
+
+// Positions with at least this many empties are stored in the
+// transposition table.
+static const int TABLE_EMPTIES      = 6;
+
+// With more than this many empties, the children of a position are looked
+// up in the transposition table before any of them is searched.
+static const int ETC_EMPTIES        = 10;
+
+// The squares whose neighbour in each of the directions of BB_DIR_SHIFT
+// is off the board.
+static const quint64 BB_DIR_EDGE[8] = {
+  Q_UINT64_C(0x8080808080808080), Q_UINT64_C(0x0101010101010101),
+  Q_UINT64_C(0xFF00000000000000), Q_UINT64_C(0x00000000000000FF),
+  Q_UINT64_C(0xFF01010101010101), Q_UINT64_C(0x80808080808080FF),
+  Q_UINT64_C(0xFF80808080808080), Q_UINT64_C(0x01010101010101FF)
+};
+
+static inline int quadrantBit(int square)
+{
+  return 1 << (((square >> 5) & 2) | ((square >> 2) & 1));
+}
+
+
+// Return the pieces in 'bits' that can never be turned: on every line
+// through them, the line is full, or the piece is at the edge of the
+// board, or it is next to another stable piece of its own.  This finds
+// most, but not all, of the stable pieces.
+static quint64 stableBits(quint64 bits, quint64 occupied)
+{
+  // full[axis] has the squares whose line along the axis is full.  A
+  // square at the edge takes whatever was shifted in from the other side
+  // of the board, but it is or'ed with the edge mask anyway.
+  quint64 full[4];
+  for (int axis = 0; axis < 4; axis++) {
+    int      dir  = 2 * axis;
+    quint64  fwd  = occupied;
+    quint64  back = occupied;
+
+    for (int i = 0; i < 7; i++) {
+      fwd  &= BB_DIR_EDGE[dir]     | shiftBits(fwd, -BB_DIR_SHIFT[dir]);
+      back &= BB_DIR_EDGE[dir + 1] | shiftBits(back, -BB_DIR_SHIFT[dir + 1]);
+    }
+    full[axis] = fwd & back;
+  }
+
+  quint64 stable = 0;
+  for (;;) {
+    quint64 next = bits;
+    for (int axis = 0; axis < 4; axis++) {
+      int dir = 2 * axis;
+      next &= full[axis] | BB_DIR_EDGE[dir] | BB_DIR_EDGE[dir + 1]
+	| shiftBits(stable, -BB_DIR_SHIFT[dir])
+	| shiftBits(stable, -BB_DIR_SHIFT[dir + 1]);
+    }
+
+    if (next == stable)
+      return stable;
+    stable = next;
+  }
+}
+
+
+// Mix the bits of x so that every bit of the result depends on every bit
+// of x (the finalizer of splitmix64).  It is a bijection.
+static inline quint64 mixBits(quint64 x)
+{
+  x ^= x >> 30;
+  x *= Q_UINT64_C(0xBF58476D1CE4E5B9);
+  x ^= x >> 27;
+  x *= Q_UINT64_C(0x94D049BB133111EB);
+  x ^= x >> 31;
+
+  return x;
+}
+
+
+// Key for the transposition table. It is not a Zobrist key like the one
+// Engine uses, since it is computed from scratch and only needs the two
+// masks. Each mask is mixed in completely: with a plain product, a bit of
+// the key would only depend on the bits of the masks below it, and
+// positions that differ in a few squares would collide often enough to
+// give wrong scores. The exhaustive key keeps it apart from heuristic
+// values.
+static inline quint64 hashPosition(quint64 own, quint64 opp)
+{
+  return mixBits(own ^ mixBits(opp)) ^ TranspositionTable::exhaustiveKey();
+}
+
+
+EndgameSolver::EndgameSolver()
+    : m_parity(0), m_table(0), m_interrupt(0), m_timer(0), m_deadline(0),
+      m_stopped(false), m_nodes(0)
+{
+  for (int square = 0; square < 64; square++) {
+    m_squares[square].m_square   = square;
+    m_squares[square].m_quadrant = quadrantBit(square);
+  }
+}
+
+
+void EndgameSolver::setInterrupt(const volatile bool* interrupt,
+				 const QElapsedTimer* timer, int deadline)
+{
+  m_interrupt = interrupt;
+  m_timer     = timer;
+  m_deadline  = deadline;
+}
+
+
+int EndgameSolver::solve(quint64 own, quint64 opp, int alpha, int beta)
+{
+  quint64 empty = ~(own | opp);
+
+  // Link the empty squares in priority order.
+  EndgameSquare* last = &m_head;
+  m_parity = 0;
+  for (int priority = 0; priority < BB_SQUARE_PRIORITIES; priority++)
+    for (int square = 0; square < 64; square++) {
+      if (!(empty & squareBit(square)) || squarePriority(square) != priority)
+	continue;
+
+      last->m_next = &m_squares[square];
+      m_squares[square].m_prev = last;
+      last = &m_squares[square];
+      m_parity ^= m_squares[square].m_quadrant;
+    }
+  last->m_next = &m_tail;
+  m_tail.m_prev = last;
+
+  m_nodes   = 0;
+  m_stopped = false;
+
+  // Tell a win from a loss with a narrow window around 0 first.  Only the
+  // half of the window that is left is then searched with the full
+  // window, and it finds the table filled by the first search.
+  int empties = bitCount(empty);
+  if (alpha < -1 && beta > 1) {
+    int val = Solve(own, opp, -1, 1, empties, false);
+    if (m_stopped || val == 0 || val >= beta || val <= alpha)
+      return val;
+
+    if (val > 0)
+      alpha = val - 1;
+    else
+      beta = val + 1;
+  }
+
+  return Solve(own, opp, alpha, beta, empties, false);
+}
+
+
+inline void EndgameSolver::Remove(EndgameSquare* empty)
+{
+  empty->m_prev->m_next = empty->m_next;
+  empty->m_next->m_prev = empty->m_prev;
+  m_parity ^= empty->m_quadrant;
+}
+
+
+inline void EndgameSolver::Restore(EndgameSquare* empty)
+{
+  empty->m_prev->m_next = empty;
+  empty->m_next->m_prev = empty;
+  m_parity ^= empty->m_quadrant;
+}
+
+
+void EndgameSolver::CheckStop()
+{
+  if ((m_interrupt && *m_interrupt)
+      || (m_deadline > 0 && m_timer->elapsed() >= m_deadline))
+    m_stopped = true;
+}
+
+
+// Pick the right function for the number of empties.
+//
+
+int EndgameSolver::Solve(quint64 own, quint64 opp, int alpha, int beta,
+			 int empties, bool passed)
+{
+  if (empties > PARITY_EMPTIES)
+    return SolveDeep(own, opp, alpha, beta, empties, passed);
+  if (empties > 4)
+    return SolveParity(own, opp, alpha, beta, empties, passed);
+
+  // Hand the last squares to the special functions, in list order.
+  int sq[4];
+  int n = 0;
+  for (EndgameSquare* e = m_head.m_next; e != &m_tail; e = e->m_next)
+    sq[n++] = e->m_square;
+
+  switch (empties) {
+  case 4:
+    return Solve4(own, opp, alpha, beta, sq[0], sq[1], sq[2], sq[3], passed);
+  case 3:
+    return Solve3(own, opp, alpha, beta, sq[0], sq[1], sq[2], passed);
+  case 2:
+    return Solve2(own, opp, alpha, beta, sq[0], sq[1], passed);
+  case 1:
+    return Solve1(own, opp, sq[0]);
+  default:
+    return bitCount(own) - bitCount(opp);
+  }
+}
+
+
+// Search with fastest first move ordering and the transposition table.
+//
+
+int EndgameSolver::SolveDeep(quint64 own, quint64 opp, int alpha, int beta,
+			     int empties, bool passed)
+{
+  if ((++m_nodes & 4095) == 0)
+    CheckStop();
+  if (m_stopped)
+    return alpha;
+
+  quint64 legal = legalMoveBits(own, opp);
+  if (legal == 0) {
+    if (passed)
+      return bitCount(own) - bitCount(opp);
+    return -Solve(opp, own, -beta, -alpha, empties, true);
+  }
+
+  // The stable pieces of the opponent stay the opponent's, which bounds
+  // the score from above.  Only worth computing when there are enough of
+  // them for the bound to cut.
+  if (64 - 2 * bitCount(opp) <= alpha) {
+    int bound = 64 - 2 * bitCount(stableBits(opp, own | opp));
+    if (bound <= alpha)
+      return bound;
+  }
+
+  // Use what is known about the position already.
+  quint64  key   = 0;
+  int      hint  = -1;
+  if (m_table && empties >= TABLE_EMPTIES) {
+    TTEntry entry;
+
+    key = hashPosition(own, opp);
+    if (m_table->probe(key, entry)) {
+      if (entry.m_bound == TranspositionTable::ExactBound)
+	return entry.m_value;
+      if (entry.m_bound == TranspositionTable::LowerBound)
+	alpha = qMax(alpha, int(entry.m_value));
+      else if (entry.m_bound == TranspositionTable::UpperBound)
+	beta = qMin(beta, int(entry.m_value));
+      if (alpha >= beta)
+	return entry.m_value;
+      hint = entry.m_move;
+    }
+  }
+  int alpha0 = alpha;
+
+  // Collect the moves with their resulting positions, and rate them by
+  // the mobility they leave to the opponent.
+  EndgameSquare*  moves[32];
+  quint64         flips[32];
+  int             rating[32];
+  int             number_of_moves = 0;
+
+  for (EndgameSquare* e = m_head.m_next; e != &m_tail; e = e->m_next) {
+    quint64 bit = squareBit(e->m_square);
+    if (!(legal & bit))
+      continue;
+
+    quint64 flipped = flippedBits(e->m_square, own, opp);
+
+    // Enhanced transposition cutoff: a child that is known to be bad
+    // enough for the opponent refutes the position without a search.
+    if (key && empties > ETC_EMPTIES) {
+      TTEntry entry;
+      if (m_table->probe(hashPosition(opp & ~flipped, own | flipped | bit), entry)
+	  && (entry.m_bound == TranspositionTable::UpperBound
+	      || entry.m_bound == TranspositionTable::ExactBound)
+	  && -entry.m_value >= beta) {
+	m_table->store(key, -entry.m_value, empties,
+		       TranspositionTable::LowerBound, e->m_square);
+	return -entry.m_value;
+      }
+    }
+
+    moves[number_of_moves]  = e;
+    flips[number_of_moves]  = flipped;
+    if (e->m_square == hint)
+      rating[number_of_moves] = -1000;
+    else
+      rating[number_of_moves] =
+	16 * bitCount(legalMoveBits(opp & ~flipped, own | flipped | bit))
+	+ 8 * bitCount(frontierBits(own | flipped | bit, ~(own | opp | bit)))
+	- ((BB_CORNERS & bit) ? 16 : 0);
+    number_of_moves++;
+  }
+
+  int best = -SCORE_INF;
+  int best_square = -1;
+
+  for (int i = 0; i < number_of_moves; i++) {
+    // Selection sort, one move at a time, since a cutoff often comes
+    // early.
+    int k = i;
+    for (int j = i + 1; j < number_of_moves; j++)
+      if (rating[j] < rating[k])
+	k = j;
+    if (k != i) {
+      qSwap(moves[i], moves[k]);
+      qSwap(flips[i], flips[k]);
+      qSwap(rating[i], rating[k]);
+    }
+
+    EndgameSquare* e = moves[i];
+    quint64 bit = squareBit(e->m_square);
+
+    // The first move gets the full window.  The others are only
+    // searched to see whether they are better, with a null window, and
+    // searched again if they are.
+    quint64 new_own = opp & ~flips[i];
+    quint64 new_opp = own | flips[i] | bit;
+    int     val;
+
+    Remove(e);
+    if (i == 0)
+      val = -Solve(new_own, new_opp, -beta, -alpha, empties - 1, false);
+    else {
+      val = -Solve(new_own, new_opp, -alpha - 1, -alpha, empties - 1, false);
+      if (val > alpha && val < beta && !m_stopped)
+	val = -Solve(new_own, new_opp, -beta, -val, empties - 1, false);
+    }
+    Restore(e);
+
+    if (m_stopped)
+      return alpha;
+
+    if (val > best) {
+      best = val;
+      best_square = e->m_square;
+      if (val > alpha) {
+	alpha = val;
+	if (alpha >= beta)
+	  break;
+      }
+    }
+  }
+
+  if (key) {
+    TranspositionTable::Bound bound;
+    if (best <= alpha0)
+      bound = TranspositionTable::UpperBound;
+    else if (best >= beta)
+      bound = TranspositionTable::LowerBound;
+    else
+      bound = TranspositionTable::ExactBound;
+    m_table->store(key, best, empties, bound, best_square);
+  }
+
+  return best;
+}
+
+
+// Search with moves into odd holes first.
+//
+
+int EndgameSolver::SolveParity(quint64 own, quint64 opp, int alpha, int beta,
+			       int empties, bool passed)
+{
+  m_nodes++;
+
+  // The stability cutoff of SolveDeep() still pays here, but not with
+  // fewer empties.
+  if (64 - 2 * bitCount(opp) <= alpha) {
+    int bound = 64 - 2 * bitCount(stableBits(opp, own | opp));
+    if (bound <= alpha)
+      return bound;
+  }
+
+  int best = -SCORE_INF;
+
+  // First the squares in quadrants with an odd number of empties, then
+  // the rest.
+  for (int odd = 1; odd >= 0; odd--) {
+    for (EndgameSquare* e = m_head.m_next; e != &m_tail; e = e->m_next) {
+      if (((m_parity & e->m_quadrant) != 0) != (odd == 1))
+	continue;
+
+      quint64 flipped = flippedBits(e->m_square, own, opp);
+      if (flipped == 0)
+	continue;
+
+      Remove(e);
+      int val = -Solve(opp & ~flipped, own | flipped | squareBit(e->m_square),
+		       -beta, -alpha, empties - 1, false);
+      Restore(e);
+
+      if (val > best) {
+	best = val;
+	if (val > alpha) {
+	  alpha = val;
+	  if (alpha >= beta)
+	    return best;
+	}
+      }
+    }
+  }
+
+  if (best == -SCORE_INF) {
+    // No legal move.
+    if (passed)
+      return bitCount(own) - bitCount(opp);
+    return -Solve(opp, own, -beta, -alpha, empties, true);
+  }
+
+  return best;
+}
+
+
+// The last four empties.  If they are spread over the quadrants as 2 and
+// 1 and 1, the two single ones (the odd holes) are tried first.
+//
+
+int EndgameSolver::Solve4(quint64 own, quint64 opp, int alpha, int beta,
+			  int sq1, int sq2, int sq3, int sq4, bool passed)
+{
+  m_nodes++;
+
+  int q1 = quadrantBit(sq1);
+  int q2 = quadrantBit(sq2);
+  int q3 = quadrantBit(sq3);
+  int q4 = quadrantBit(sq4);
+
+  if (q1 == q2 && q3 != q4) {
+    qSwap(sq1, sq3);  // sq3, sq4, sq1, sq2
+    qSwap(sq2, sq4);
+  }
+  else if (q1 == q3 && q2 != q4) {
+    qSwap(sq1, sq2);  // sq2, sq4, sq1, sq3
+    qSwap(sq2, sq4);
+    qSwap(sq3, sq4);
+  }
+  else if (q1 == q4 && q2 != q3) {
+    qSwap(sq1, sq2);  // sq2, sq3, sq1, sq4
+    qSwap(sq2, sq3);
+  }
+
+  int best = -SCORE_INF;
+  int sq[4] = { sq1, sq2, sq3, sq4 };
+
+  for (int i = 0; i < 4; i++) {
+    quint64 flipped = flippedBits(sq[i], own, opp);
+    if (flipped == 0)
+      continue;
+
+    int rest[3];
+    for (int j = 0, k = 0; j < 4; j++)
+      if (j != i)
+	rest[k++] = sq[j];
+
+    int val = -Solve3(opp & ~flipped, own | flipped | squareBit(sq[i]),
+		      -beta, -alpha, rest[0], rest[1], rest[2], false);
+    if (val > best) {
+      best = val;
+      if (val > alpha) {
+	alpha = val;
+	if (alpha >= beta)
+	  return best;
+      }
+    }
+  }
+
+  if (best == -SCORE_INF) {
+    if (passed)
+      return bitCount(own) - bitCount(opp);
+    return -Solve4(opp, own, -beta, -alpha, sq1, sq2, sq3, sq4, true);
+  }
+
+  return best;
+}
+
+
+// The last three empties.  A square alone in its quadrant is tried
+// first.
+//
+
+int EndgameSolver::Solve3(quint64 own, quint64 opp, int alpha, int beta,
+			  int sq1, int sq2, int sq3, bool passed)
+{
+  m_nodes++;
+
+  int q1 = quadrantBit(sq1);
+  int q2 = quadrantBit(sq2);
+  int q3 = quadrantBit(sq3);
+
+  if (q1 == q2 && q1 != q3)
+    qSwap(sq1, sq3);
+  else if (q1 == q3 && q1 != q2)
+    qSwap(sq1, sq2);
+
+  int best = -SCORE_INF;
+  quint64 flipped;
+
+  if ((flipped = flippedBits(sq1, own, opp))) {
+    best = -Solve2(opp & ~flipped, own | flipped | squareBit(sq1),
+		   -beta, -alpha, sq2, sq3, false);
+    if (best >= beta)
+      return best;
+    alpha = qMax(alpha, best);
+  }
+
+  if ((flipped = flippedBits(sq2, own, opp))) {
+    int val = -Solve2(opp & ~flipped, own | flipped | squareBit(sq2),
+		      -beta, -alpha, sq1, sq3, false);
+    if (val > best) {
+      best = val;
+      if (best >= beta)
+	return best;
+      alpha = qMax(alpha, best);
+    }
+  }
+
+  if ((flipped = flippedBits(sq3, own, opp))) {
+    int val = -Solve2(opp & ~flipped, own | flipped | squareBit(sq3),
+		      -beta, -alpha, sq1, sq2, false);
+    if (val > best)
+      best = val;
+  }
+
+  if (best == -SCORE_INF) {
+    if (passed)
+      return bitCount(own) - bitCount(opp);
+    return -Solve3(opp, own, -beta, -alpha, sq1, sq2, sq3, true);
+  }
+
+  return best;
+}
+
+
+// The last two empties.
+//
+
+int EndgameSolver::Solve2(quint64 own, quint64 opp, int alpha, int beta,
+			  int sq1, int sq2, bool passed)
+{
+  m_nodes++;
+
+  int best = -SCORE_INF;
+  quint64 flipped;
+
+  if ((flipped = flippedBits(sq1, own, opp))) {
+    best = -Solve1(opp & ~flipped, own | flipped | squareBit(sq1), sq2);
+    if (best >= beta)
+      return best;
+  }
+
+  if ((flipped = flippedBits(sq2, own, opp))) {
+    int val = -Solve1(opp & ~flipped, own | flipped | squareBit(sq2), sq1);
+    if (val > best)
+      best = val;
+  }
+
+  if (best == -SCORE_INF) {
+    if (passed)
+      return bitCount(own) - bitCount(opp);
+    return -Solve2(opp, own, -beta, -alpha, sq1, sq2, true);
+  }
+
+  return best;
+}
+
+
+// The last empty square.  Only the number of turned pieces matters, so
+// no position is built.
+//
+
+int EndgameSolver::Solve1(quint64 own, quint64 opp, int sq)
+{
+  m_nodes++;
+
+  int score = bitCount(own) - bitCount(opp);
+  int turned;
+
+  if ((turned = bitCount(flippedBits(sq, own, opp))))
+    return score + 2 * turned + 1;
+  if ((turned = bitCount(flippedBits(sq, opp, own))))
+    return score - 2 * turned - 1;
+
+  return score;
+}
@@ -0,0 +1,112 @@
+#ifndef KREVERSI_ENDGAMESOLVER_H
+#define KREVERSI_ENDGAMESOLVER_H
+
+#include <QtGlobal>
+
+class QElapsedTimer;
+class TranspositionTable;
+
+// EndgameSolver computes the exact final score of a position, that is
+// the number of pieces of the side to move minus those of its opponent
+// when the game is over, with perfect play from both sides.
+//
+// It is a plain alpha-beta search like the one in Engine, but tuned for
+// the last 20 or fewer empty squares, where the tree is searched all
+// the way to the end of the game:
+//
+//  - The empty squares are kept in a linked list, presorted with the best
+//    squares (corners) first. Making a move unlinks its square, so moves
+//    are generated by walking the list instead of all 64 squares.
+//
+//  - The board is split in four quadrants, and m_parity has a bit set for
+//    every quadrant with an odd number of empty squares (an odd "hole").
+//    Playing into an odd hole tends to get the last move in that region,
+//    so with few empties left, moves in odd holes are tried first.
+//
+//  - With more empties, the moves are sorted "fastest first": the moves
+//    that leave the opponent with the fewest replies (and the fewest of
+//    our pieces next to empty squares) come first, since they give the
+//    smallest subtrees and usually the best results. Only the first move
+//    is searched with the full window, the others just have to be shown
+//    to be no better.
+//    Results are kept in a transposition table (if one is given), keyed
+//    by a hash of the two masks. With many empties, the children are
+//    looked up in it first, since one of them may already be known to
+//    refute the position (enhanced transposition cutoff).
+//
+//  - The stable pieces of the opponent, those that can never be turned,
+//    bound the score from above. When the bound is below the window, the
+//    position is cut off without generating its moves.
+//
+//  - solve() tells a win from a loss with a narrow window around 0
+//    before it searches the rest of a wide window.
+//
+//  - The last 4, 3, 2 and 1 empties are handled by special functions
+//    that get the squares as arguments and do no bookkeeping at all.
+
+class EndgameSquare
+{
+public:
+  int             m_square;
+  int             m_quadrant;   // bit of the quadrant in m_parity
+  EndgameSquare*  m_prev;
+  EndgameSquare*  m_next;
+};
+
+
+class EndgameSolver
+{
+public:
+  EndgameSolver();
+
+  // Share a transposition table with the solver. May be 0.
+  void  setTable(TranspositionTable* table) { m_table = table; }
+
+  // The solver stops as soon as *interrupt is true or, if deadline is
+  // greater than 0, timer has passed deadline milliseconds. The result
+  // of an interrupted solve() is meaningless.
+  void  setInterrupt(const volatile bool* interrupt,
+		     const QElapsedTimer* timer, int deadline);
+  bool  stopped() const { return m_stopped; }
+
+  // Return the final score of the position where 'own' is to move, if it
+  // is inside the window (alpha, beta). Otherwise a bound beyond the
+  // window is returned.
+  int   solve(quint64 own, quint64 opp, int alpha, int beta);
+
+  // Number of positions visited by the last solve().
+  quint64  nodes() const { return m_nodes; }
+
+private:
+  int   Solve(quint64 own, quint64 opp, int alpha, int beta,
+	      int empties, bool passed);
+  int   SolveDeep(quint64 own, quint64 opp, int alpha, int beta,
+		  int empties, bool passed);
+  int   SolveParity(quint64 own, quint64 opp, int alpha, int beta,
+		    int empties, bool passed);
+  int   Solve4(quint64 own, quint64 opp, int alpha, int beta,
+	       int sq1, int sq2, int sq3, int sq4, bool passed);
+  int   Solve3(quint64 own, quint64 opp, int alpha, int beta,
+	       int sq1, int sq2, int sq3, bool passed);
+  int   Solve2(quint64 own, quint64 opp, int alpha, int beta,
+	       int sq1, int sq2, bool passed);
+  int   Solve1(quint64 own, quint64 opp, int sq);
+
+  void  Remove(EndgameSquare* empty);
+  void  Restore(EndgameSquare* empty);
+  void  CheckStop();
+
+  EndgameSquare   m_squares[64];
+  EndgameSquare   m_head;        // sentinel before the first empty square
+  EndgameSquare   m_tail;        // sentinel after the last one
+  int             m_parity;
+
+  TranspositionTable*    m_table;
+  const volatile bool*   m_interrupt;
+  const QElapsedTimer*   m_timer;
+  int                    m_deadline;
+  bool                   m_stopped;
+  quint64                m_nodes;
+};
+
+#endif
@@ -70,48 +70,92 @@
 // next to a corner is not very good and they give a lower value. In the
 // beginning of a game it is more important to have pieces on "good" squares,
 // but towards the end the total number of pieces of each color is given a
-// higher weight. Other things, like how many legal moves that can be made in a
-// position, and the number of pieces that can never be turned would probably
-// make the program stronger if they were considered in evaluating a position,
-// but that would make things more complicated (this was meant to be very
-// simple example) and would also slow down computation (considerably?).
+// higher weight. How many legal moves each side can make in the position
+// (the mobility) and how many of its pieces are next to empty squares (the
+// frontier, which gives the opponent moves) are weighted like the squares.
+// Counting moves square by square would slow down computation considerably,
+// but on the masks described below both are found for the whole board with
+// a few shifts (see positionalScoreBits() in Bitboard.h). The number of
+// pieces that can never be turned would probably make the program stronger
+// too, but that is left out to keep things simple.
 //
-// The member m_board[10][10]) holds the current position during the
-// computation. It is initiated at the start of ComputeMove() and
-// every move that is made during the search is made on this board. It should
-// be noted that 1 to 8 is used for the actual board, but 0 and 9 can be
-// used too (they are always empty). This is practical when turning pieces
-// when moves are made on the board. Every piece that is put on the board
-// or turned is saved in the stack m_squarestack (see class SquareStack) so
-// every move can easily be reversed after the search in a node is completed.
-// Engine m_board uses index 1 til 8. But KReversiGame board uses index 0 til 7.
-// So ComputeMove will return move with index 0 til 7. But other than that,
-// Engine will always consider move starting with index 1
+// The member m_board[10][10] holds the current position as it was handed
+// over from the game. It should be noted that 1 to 8 is used for the actual
+// board, but 0 and 9 can be used too (they are always empty). The search
+// itself does not use m_board. Before it starts, the position is converted
+// to two 64 bit masks, one for each color (see Bitboard.h), and every node
+// of the search tree works on such a pair of masks. Legal moves are then
+// generated for all squares at once with a few shifts and masks, and a
+// move is made by or'ing in the new piece and the turned pieces. Since the
+// masks are passed by value, a move is taken back simply by returning to
+// the caller, so nothing has to be saved on the way down.
 //
-// The member m_bc_board[][] holds board control values for each square
-// and is initiated by a call to the function private void SetupBcBoard()
-// from Engines constructor. It is used in evaluation of positions except
-// when the game tree is searched all the way to the end of the game.
+// The member m_bc_board[][] holds board control values for each square.
+// It is a constant table, like dcol[] and drow[], so no engine has to set
+// it up and the compiler may fold its values. It is used in evaluation of
+// positions except when the game tree is searched all the way to the end
+// of the game. The search sums the values with the masks in Bitboard.h,
+// which group the squares of m_bc_board by value.
 //
-// The two members m_coord_bit[9][9] and m_neighbor_bits[9][9] are used to
-// speed up the tree search. This goes against the principle of keeping things
-// simple, but to understand the program you do not need to understand them
-// at all. They are there to make it possible to throw away moves where
-// the piece that is played is not adjacent to a piece of opposite color
-// at an early stage (because they could never be legal). It should be
-// pointed out that not all moves that pass this test are legal, there will
-// just be fewer moves that have to be tested in a more time consuming way.
+// Square (i, j) of m_board is bit (i - 1) * 8 + j - 1 of the masks.
+// Nothing of this is held per engine, so constructing one costs no more
+// than setting up its members.
 //
-// There are also two other members that should be mentioned: Score m_score
-// and Score m_bc_score. They hold the number of pieces of each color and
-// the sum of the board control values for each color during the search
-// (this is faster than counting at every leaf node).
+// Along with the masks, every node gets the Zobrist key of its position
+// (see TranspositionTable.h), which is updated with a few XORs when a
+// piece is put down or turned. TryAllMoves() looks the key up in the
+// transposition table m_tt before it searches a position. If the position
+// has already been searched deep enough, the stored value is used
+// directly, otherwise the stored best move is at least tried first.
+// The other moves are tried in the order m_ordering (see MoveOrdering.h)
+// gives them, which puts the moves that refuted similar positions before
+// the rest. At the root, the moves are tried in the order of their values
+// from the previous iteration.
 //
-
-// The classes SquareStackEntry and SquareStack implement a
-// stack that is used by Engine to store pieces that are turned during
-// searching (see ComputeMove()).
+// Since the first move is then usually the best, only it is searched with
+// the full alpha-beta window. The other moves are first searched with a
+// null window, which only tells whether they are better, and searched
+// again if they are (principal variation search). Along the way, the
+// search collects the principal variation, the line of play it expects,
+// which principalVariation() returns.
+//
+// If a file with pattern weights is installed (see PatternEval.h), the
+// linear evaluation is replaced by m_pattern_eval, which looks up
+// weights for the contents of the edges, corners and diagonals, and also
+// considers the mobility of both sides. The search keeps the indices of
+// the patterns in m_features up to date as it makes and takes back
+// moves, so an evaluation only has to add up a few dozen weights.
+//
+// Before any of this, the AI asks bookMove() for a move of the opening
+// book (see OpeningBook.h), if one is installed. Well known openings are
+// then played at once instead of being searched again every game.
+//
+// When the search would reach the end of the game, the root moves are
+// instead handed to m_solver (see EndgameSolver.h), which computes their
+// exact final scores much faster than the general search. With a time
+// budget and at most 16 empty squares left, the search goes for the exact
+// scores as soon as it has a move to fall back to.
+//
+// searchMove() searches in the thread that calls it, which in the game
+// is never the GUI thread (see AiWorker). Only the helpers of a search
+// with several threads (Lazy SMP) run in SearchThreads of their own. Each
+// helper has its own Engine, so nothing but the transposition table is
+// shared.
+//
+// There is also another member that should be mentioned: Score m_score.
+// It holds the number of pieces of each color in the position the engine
+// was set up with.
 //
+// Nothing the search does for a node allocates memory: the positions live
+// in the masks passed down the call stack, and everything else that
+// depends on the ply (the principal variations, the killer moves) is in
+// fixed arrays indexed by it. Only a search as a whole allocates: the
+// transposition table the first time, the helpers and their threads when
+// it uses several, and for every iteration its value in
+// m_iteration_values and the debug output. kreversi-allocations checks
+// that this stays so.
+//
+
 // The class MoveAndValue is used by Engine to store all possible moves
 // at the first level and the values that were calculated for them.
 // This makes it possible to select a random move among those with equal
@@ -119,78 +163,12 @@
 
 
 #include "Engine.h"
-#include "kreversigame.h"
-#include <QApplication>
+#include <QMutex>
+#include <QThread>
 #include <KDebug>
+#include <KStandardDirs>
 #include <cmath>
 
-// ================================================================
-//           Classes SquareStackEntry and SquareStack
-
-
-// A SquareStack is used to store changes to the squares on the board
-// during search.
-
-
-inline void SquareStackEntry::setXY(int x, int y) {
-  m_x = x;
-  m_y = y;
-}
-
-
-SquareStackEntry::SquareStackEntry()
-{
-  setXY(0,0);
-}
-
-
-// ----------------------------------------------------------------
-
-
-SquareStack::SquareStack() {
-  init(0);
-}
-
-
-SquareStack::SquareStack(int size) {
-  init(size);
-}
-
-
-void SquareStack::resize(int size)
-{
-  m_squarestack.resize(size);
-}
-
-
-// (Re)initialize the stack so that is empty, and at the same time
-// resize it to 'size'.
-//
-
-void SquareStack::init(int size)
-{
-  resize(size);
-
-  m_top = 0;
-  for (int i = 0; i < size; i++)
-    m_squarestack[i].setXY(0,0);
-}
-
-
-
-inline SquareStackEntry SquareStack::Pop()
-{
-  return m_squarestack[--m_top];
-}
-
-
-inline void SquareStack::Push(int x, int y)
-{
-  m_squarestack[m_top].m_x = x;
-  m_squarestack[m_top++].m_y = y;
-}
-
-
 // ================================================================
 //                       Class MoveAndValue
 
@@ -219,91 +197,132 @@ MoveAndValue::MoveAndValue(int x, int y, int value)
 }
 
 // ================================================================
-//                       class Score
+//                        The Engine itself
 
-/* This class keeps track of the score for both colors.  Such a score
- * could be either the number of pieces, the score from the evaluation
- * function or anything similar.
- */
-class Score {
-public:
-  Score()
-  {
-      m_score[White] = 0;
-      m_score[Black] = 0;
-  }
 
-  uint score(ChipColor color) const     { return m_score[color]; }
+// Some special values used in the search.
+static const int LARGEINT      = 99999;
+static const int ILLEGAL_VALUE = 8888888;
 
-  void set(ChipColor color, uint score) { m_score[color] = score; }
-  void inc(ChipColor color)             { m_score[color]++; }
-  void dec(ChipColor color)             { m_score[color]--; }
-  void add(ChipColor color, uint s)     { m_score[color] += s; }
-  void sub(ChipColor color, uint s)     { m_score[color] -= s; }
+// Size of the transposition table in MB.
+static const int TT_MEGABYTES  = 16;
 
-private:
-  uint  m_score[2];
+// With a time budget and at most this many empty squares left, the search
+// jumps to an exhaustive search, which the endgame solver finishes well
+// under a second.  With a few more empties it can take many seconds.
+static const int ENDGAME_SOLVER_EMPTIES = 16;
+
+// With a time budget, the endgame solver takes over after the heuristic
+// iterations have reached this depth, so that there is a reasonable
+// move to fall back to if it does not finish in time.
+static const int ENDGAME_FALLBACK_DEPTH = 6;
+
+// Moves are ordered by the mobility they leave the opponent where at
+// least this many plies are left to search, and by their history scores
+// below that.
+static const int MOBILITY_ORDER_DEPTH = 4;
+
+// Half the width of the aspiration window: each iteration first searches
+// the root with a window this far around the value of the previous one.
+static const int ASPIRATION_WINDOW = 200;
+
+// Name of the file with the parameters of Multi-ProbCut.
+static const char PROBCUT_FILE[] = "probcut.bin";
+
+// For each selectivity, how many sigmas (in hundredths) the value
+// predicted by the shallow search has to be beyond the window to cut off
+// the deep search.
+static const int PROBCUT_THRESHOLD[Engine::MAX_SELECTIVITY + 1] = {
+  0, 250, 180, 130, 90
 };
 
-// ================================================================
-//                        The Engine itself
+// ProbCut is not used when the window is this close to a sure win or
+// loss, whose values no fitted line can predict.
+static const int PROBCUT_MAX_VALUE = LARGEINT - 200;
 
+// Name of the file with the weights of the pattern evaluation.
+static const char PATTERN_WEIGHTS_FILE[] = "pattern_weights.bin";
+
+// Name of the opening book file.
+static const char OPENING_BOOK_FILE[] = "opening_book.bin";
+
+// In competitive games, book moves whose win rate is more than this much
+// (in 1/10000) below the best one are not played.
+static const int BOOK_WIN_RATE_MARGIN = 300;
 
-// Some special values used in the search.
-static const int LARGEINT      = 99999;
-static const int ILLEGAL_VALUE = 8888888;
-static const int BC_WEIGHT     = 3;
 char Engine::DARK_REP = '0';
 char Engine::LIGHT_REP = '1';
 char Engine::NONE_REP = '2';
 char Engine::TIE_REP = '3';
 
-int Engine::dcol[] = { 0, 1, 0, -1, 1, 1, -1, -1 };
-int Engine::drow[] = { -1, 0, 1, 0, -1, 1, -1, 1 };
-int Engine::m_bc_board[9][9];
+const int Engine::dcol[8] = { 0, 1, 0, -1, 1, 1, -1, -1 };
+const int Engine::drow[8] = { -1, 0, 1, 0, -1, 1, -1, 1 };
+
+// The board control values.  Row and column 0 are not used.
+const int Engine::m_bc_board[9][9] = {
+  { 0,  0,  0,  0,  0,  0,  0,  0,  0 },
+  { 0,  2, -1,  0,  0,  0,  0, -1,  2 },
+  { 0, -1, -2, -1, -1, -1, -1, -2, -1 },
+  { 0,  0, -1,  0,  0,  0,  0, -1,  0 },
+  { 0,  0, -1,  0,  0,  0,  0, -1,  0 },
+  { 0,  0, -1,  0,  0,  0,  0, -1,  0 },
+  { 0,  0, -1,  0,  0,  0,  0, -1,  0 },
+  { 0, -1, -2, -1, -1, -1, -1, -2, -1 },
+  { 0,  2, -1,  0,  0,  0,  0, -1,  2 }
+};
 
 Engine::Engine(int st, int sd)/* : SuperEngine(st, sd) */
-    : m_strength(st), m_computingMove( false )
+    : m_competitive(true), m_strength(st), m_selectivity(0), m_interrupt(false),
+      m_cancel(&m_interrupt), m_time_budget(0), m_hard_deadline(0), m_time_up(false),
+      m_pondering(false), m_pondered(false), m_ponder_coeff(0),
+      m_root_pv_length(0), m_pattern_eval(0), m_probcut(0), m_in_probcut(false),
+      m_tt(&m_own_tt), m_threads(1), m_helper_index(0), m_computingMove( false )
 {
   m_random.setSeed(sd);
-  m_score = new Score;
-  m_bc_score = new Score;
-  SetupBcBoard();
-  SetupBits();
 }
 
 
 Engine::Engine(int st) //: SuperEngine(st)
-    : m_strength(st), m_computingMove(false)
+    : m_competitive(true), m_strength(st), m_selectivity(0), m_interrupt(false),
+      m_cancel(&m_interrupt), m_time_budget(0), m_hard_deadline(0), m_time_up(false),
+      m_pondering(false), m_pondered(false), m_ponder_coeff(0),
+      m_root_pv_length(0), m_pattern_eval(0), m_probcut(0), m_in_probcut(false),
+      m_tt(&m_own_tt), m_threads(1), m_helper_index(0), m_computingMove(false)
 {
   m_random.setSeed(0);
-  m_score = new Score;
-  m_bc_score = new Score;
-  SetupBcBoard();
-  SetupBits();
 }
 
 
 Engine::Engine()// : SuperEngine(1)
-    : m_strength(1), m_computingMove(false)
+    : m_competitive(true), m_strength(1), m_selectivity(0), m_interrupt(false),
+      m_cancel(&m_interrupt), m_time_budget(0), m_hard_deadline(0), m_time_up(false),
+      m_pondering(false), m_pondered(false), m_ponder_coeff(0),
+      m_root_pv_length(0), m_pattern_eval(0), m_probcut(0), m_in_probcut(false),
+      m_tt(&m_own_tt), m_threads(1), m_helper_index(0), m_computingMove(false)
 {
   m_random.setSeed(0);
-  m_score = new Score;
-  m_bc_score = new Score;
-  SetupBcBoard();
-  SetupBits();
 }
 
 //customized for lua ai implementation
-Engine::Engine(std::string game_state)
-    : m_strength(1), m_computingMove(false)
+Engine::Engine(const std::string& game_state)
+    : m_competitive(true), m_strength(1), m_selectivity(0), m_interrupt(false),
+      m_cancel(&m_interrupt), m_time_budget(0), m_hard_deadline(0),
+      m_time_up(false), m_pondering(false), m_pondered(false), m_ponder_coeff(0),
+      m_root_pv_length(0), m_pattern_eval(0), m_probcut(0), m_in_probcut(false),
+      m_tt(&m_own_tt), m_threads(1), m_helper_index(0), m_computingMove(false)
 {
   m_random.setSeed(0);
-  m_score = new Score;
-  m_bc_score = new Score;
-  SetupBcBoard();
-  SetupBits();
+  setGameState(game_state);
+}
 
+
+// Set up the position given by game_state, in the format of
+// getGameStateString().  An engine that is set up again keeps its
+// transposition table, unlike a new one for every position.
+//
+
+void Engine::setGameState(const std::string& game_state)
+{
   int count = 0;
   // Initialize the board with game_state
   for (uint x = 0; x < 10; x++) {
@@ -320,12 +339,6 @@ Engine::Engine(std::string game_state)
   //get turn
   m_turn = char2ChipColor(game_state[64]);
 
-  // Initialize m_bc_score to the current bc score.  This is kept
-  // up-to-date incrementally so that way we won't have to calculate
-  // it from scratch for each evaluation.
-  m_bc_score->set(White, CalcBcScore(White));
-  m_bc_score->set(Black, CalcBcScore(Black));
-
   int    score_black    = 0;
   int    score_white = 0;
 
@@ -339,37 +352,35 @@ Engine::Engine(std::string game_state)
   }
 
   // Figure out the current score
-  m_score->set(White, score_white);
-  m_score->set(Black, score_black);
+  m_score.set(White, score_white);
+  m_score.set(Black, score_black);
 
   // Get the search depth.  If we are close to the end of the game,
   // the number of possible moves goes down, so we can search deeper
   // without using more time.
   m_depth = m_strength;
-  if (m_score->score(White) + m_score->score(Black) + m_depth + 3 >= 64) // 3 chips away from end game
-    m_depth = 64 - m_score->score(White) - m_score->score(Black);
-  else if (m_score->score(White) + m_score->score(Black) + m_depth + 4 >= 64) // 4 chips away from end game
+  if (m_score.score(White) + m_score.score(Black) + m_depth + 3 >= 64) // 3 chips away from end game
+    m_depth = 64 - m_score.score(White) - m_score.score(Black);
+  else if (m_score.score(White) + m_score.score(Black) + m_depth + 4 >= 64) // 4 chips away from end game
     m_depth += 2;
-  else if (m_score->score(White) + m_score->score(Black) + m_depth + 5 >= 64) // 5 chips away from end game
+  else if (m_score.score(White) + m_score.score(Black) + m_depth + 5 >= 64) // 5 chips away from end game
     m_depth++;
 
   // The evaluation is a linear combination of the score (number of
   // pieces) and the sum of the scores for the squares (given by
-  // m_bc_score).  The earlier in the game, the more we use the square
+  // m_bc_board).  The earlier in the game, the more we use the square
   // values and the later in the game the more we use the number of
   // pieces.
-  m_coeff = 100 - (100 * (m_score->score(White) + m_score->score(Black)+ m_depth - 4)) / 60;
+  m_coeff = 100 - (100 * (m_score.score(White) + m_score.score(Black)+ m_depth - 4)) / 60;
 
   // If we are very close to the end, we can even make the search
   // exhaustive.
-  if (m_score->score(White) + m_score->score(Black) + m_depth >= 64)
-    m_exhaustive = true;
+  m_exhaustive = m_score.score(White) + m_score.score(Black) + m_depth >= 64;
 }
 
 Engine::~Engine()
 {
-    delete m_score;
-    delete m_bc_score;
+    qDeleteAll(m_helpers);
 }
 
 std::string Engine::getGameStateString() const {
@@ -436,16 +447,8 @@ int Engine::getNumberOfMovesWithPass() {
 
 int Engine::getNumberOfMoves(ChipColor turn)
 {
-    int count = 0;
-
-    for (int i = 1; i <= 8; i++) {
-        for (int j = 1; j <= 8; j++) {
-            if (isLegalMove(turn, i, j))
-                count++;
-        }
-    }
-
-    return count;
+    return bitCount(legalMoveBits(ComputeOccupiedBits(turn),
+                                  ComputeOccupiedBits(opponentColorFor(turn))));
 }
 
 PosList Engine::getAllMoves() const {
@@ -543,21 +546,16 @@ char Engine::chipColor2Char(ChipColor chip_color) {
 // state.NONE nobody wins yet(game hasnt finished yet)
 int Engine::whoWin()
 {
-    if (getNumberOfMoves(Black) != 0 || getNumberOfMoves(White) != 0) {
+    quint64 black_bits = ComputeOccupiedBits(Black);
+    quint64 white_bits = ComputeOccupiedBits(White);
+
+    if (legalMoveBits(black_bits, white_bits) != 0
+        || legalMoveBits(white_bits, black_bits) != 0) {
         return NONE_REP; // nobody wins yet
     }
 
-    int dark_pieces = 0;
-    int light_pieces = 0;
-
-    for (int i = 1; i <= 8; i++) {
-        for (int j = 1; j <= 8; j++) {
-            if (m_board[i][j] == Black)
-                dark_pieces++;
-            else if (m_board[i][j] == White)
-                light_pieces++;
-        }
-    }
+    int dark_pieces = bitCount(black_bits);
+    int light_pieces = bitCount(white_bits);
 
     if (dark_pieces > light_pieces)
         return DARK_REP;
@@ -567,34 +565,192 @@ int Engine::whoWin()
         return TIE_REP;
 }
 
-// keep GUI alive
-void Engine::yield()
+// The weights of the pattern evaluation, shared by all engines.  The
+// file is mapped the first time they are asked for.  Returns 0 if it is
+// not installed, and the linear evaluation has to do.  Engines may
+// search in several threads at once, so the loading is guarded by a
+// mutex.
+
+static QMutex  s_pattern_eval_mutex;
+
+static const PatternEval* sharedPatternEval()
+{
+  static PatternEval*  s_pattern_eval = 0;
+  static bool          s_loaded = false;
+
+  QMutexLocker locker(&s_pattern_eval_mutex);
+  if (!s_loaded) {
+    s_loaded = true;
+
+    QString path = KStandardDirs::locate("appdata", PATTERN_WEIGHTS_FILE);
+    PatternEval* pattern_eval = new PatternEval;
+    if (!path.isEmpty() && pattern_eval->load(path))
+      s_pattern_eval = pattern_eval;
+    else
+      delete pattern_eval;
+
+    kDebug() << "pattern evaluation : " << (s_pattern_eval != 0);
+  }
+
+  return s_pattern_eval;
+}
+
+
+// The opening book, shared by all engines like the pattern weights.
+// Returns 0 if it is not installed.
+
+static QMutex  s_opening_book_mutex;
+
+static const OpeningBook* sharedOpeningBook()
 {
-  qApp->processEvents();
+  static OpeningBook*  s_opening_book = 0;
+  static bool          s_loaded = false;
+
+  QMutexLocker locker(&s_opening_book_mutex);
+  if (!s_loaded) {
+    s_loaded = true;
+
+    QString path = KStandardDirs::locate("appdata", OPENING_BOOK_FILE);
+    OpeningBook* opening_book = new OpeningBook;
+    if (!path.isEmpty() && opening_book->load(path))
+      s_opening_book = opening_book;
+    else
+      delete opening_book;
+
+    kDebug() << "opening book : "
+	     << (s_opening_book ? s_opening_book->size() : 0) << " moves";
+  }
+
+  return s_opening_book;
 }
 
 
-// Calculate the best move from the current position, and return it.
-KReversiPos Engine::computeMove(const KReversiGame& game, bool competitive)
+// The parameters of Multi-ProbCut, shared by all engines like the
+// pattern weights.  Returns 0 if they are not installed.
+
+static QMutex  s_probcut_mutex;
+
+static const ProbCut* sharedProbCut()
 {
-    // Initialize the board that we use for the search.
-    for (uint row = 0; row < 10; row++) {
-      for (uint col = 0; col < 10; col++) {
-        if (1 <= row && row <= 8 && 1 <= col && col <= 8)
-            m_board[row][col] = game.chipColorAt(row-1, col-1);
-        else
-            m_board[row][col] = NoColor;
-      }
-    }
+  static ProbCut*  s_probcut = 0;
+  static bool      s_loaded = false;
+
+  QMutexLocker locker(&s_probcut_mutex);
+  if (!s_loaded) {
+    s_loaded = true;
+
+    QString path = KStandardDirs::locate("appdata", PROBCUT_FILE);
+    ProbCut* probcut = new ProbCut;
+    if (!path.isEmpty() && probcut->load(path))
+      s_probcut = probcut;
+    else
+      delete probcut;
+
+    kDebug() << "probcut : " << (s_probcut != 0);
+  }
+
+  return s_probcut;
+}
+
+
+// Return a move of the opening book for m_turn in the position held by
+// m_board, or an invalid move if the book has none (or is not there).
+//
+// The move is picked at random, with the number of games it was played
+// in as weight, so that the engine does not always play the same
+// opening.  In a competitive game only moves that scored about as well
+// as the best one take part.
+
+KReversiPos Engine::bookMove()
+{
+  const OpeningBook* book = sharedOpeningBook();
+  ChipColor color = m_turn;
+  if (book == 0 || color == NoColor)
+    return KReversiPos();
+
+  quint64 colorbits    = ComputeOccupiedBits(color);
+  quint64 opponentbits = ComputeOccupiedBits(opponentColorFor(color));
+  quint64 legal        = legalMoveBits(colorbits, opponentbits);
+
+  QList<BookMove> moves = color == Black
+    ? book->lookup(colorbits, opponentbits, color)
+    : book->lookup(opponentbits, colorbits, color);
+
+  // The key of a position could also belong to another one, so only
+  // legal moves are taken.
+  int best_win_rate = 0;
+  for (int i = moves.size() - 1; i >= 0; i--) {
+    if (!(legal & squareBit(moves[i].m_square)))
+      moves.removeAt(i);
+    else
+      best_win_rate = qMax(best_win_rate, moves[i].m_win_rate);
+  }
+
+  int total = 0;
+  for (int i = 0; i < moves.size(); i++) {
+    if (m_competitive && moves[i].m_win_rate < best_win_rate - BOOK_WIN_RATE_MARGIN)
+      moves[i].m_games = 0;
+    total += moves[i].m_games;
+  }
+
+  if (total == 0)
+    return KReversiPos();
+
+  int r = m_random.getLong(total);
+  int i = 0;
+  while (r >= moves[i].m_games) {
+    r -= moves[i].m_games;
+    i++;
+  }
+
+  kDebug() << "book move : " << moves[i].m_square / 8 << " " << moves[i].m_square % 8
+	   << " games " << moves[i].m_games << " win rate " << moves[i].m_win_rate;
+  return KReversiPos(color, moves[i].m_square / 8, moves[i].m_square % 8);
+}
+
+
+// A SearchThread runs the iterative deepening of a helper engine.  The
+// main engine searches in the thread that asked for the move, which is
+// never the GUI thread (see AiWorker).
+
+class SearchThread : public QThread
+{
+public:
+  SearchThread(Engine* engine) : m_engine(engine) {}
 
-    m_turn = game.currentPlayer();
+protected:
+  void run() { m_engine->SearchIterations(); }
 
-    kDebug() << "----------AI"<< game.currentPlayer() <<" is Thinking-------------------------";
+private:
+  Engine* m_engine;
+};
 
-    return game.getAi(game.currentPlayer())->selectMove(*this);
-    // ###################################################################################
-    kDebug() << "There are : " << game.possibleMoves().size() << " moves";
 
+// Calculate the best move for m_turn in the position held by m_board
+// with the native alpha-beta search, and return it.
+//
+// The search is iterative deepening: the position is searched to depth
+// 1, 2, 3 and so on.  Each iteration searches the best move of the
+// previous one first and leaves best moves for the inner nodes in the
+// transposition table, so the deeper searches get good move ordering and
+// the shallow ones cost little in comparison.
+//
+// Without a time budget, the iterations stop at the depth given by the
+// strength.  With a time budget (see setTimeBudget()) they go on until
+// half the budget is used up (the soft deadline), since the next
+// iteration would most likely not finish anyway.  An iteration that is
+// still running when the whole budget is used (the hard deadline) is
+// abandoned, and the result of the last completed one is used.
+//
+// With more than one thread (see setThreads()), helper engines search
+// the same position at the same time, each in a thread of its own and
+// with its own copy of the position.  They share the transposition table
+// with this engine and start at other depths and with other moves, so
+// they fill the table with results that this engine then finds ready
+// (this is known as "Lazy SMP").  Only the result of this engine is
+// used; the helpers are stopped when it is done.
+KReversiPos Engine::searchMove()
+{
     if( m_computingMove )
     {
         kDebug() << "I'm already computing move! Yours KReversi Engine.";
@@ -602,176 +758,164 @@ KReversiPos Engine::computeMove(const KReversiGame& game, bool competitive)
     }
     m_computingMove = true;
 
-  ChipColor color;
-
-  // A competitive game is one where we try our damnedest to make the
-  // best move.  The opposite is a casual game where the engine might
-  // make "a mistake".  The idea behind this is not to scare away
-  // newbies.  The member m_competitive is used during search for this
-  // very move.
-  m_competitive = competitive;
-
-  // Suppose that we should give a heuristic evaluation.  If we are
-  // close to the end of the game we can make an exhaustive search,
-  // but that case is determined further down.
-  m_exhaustive = false;
-
   // Get the color to calculate the move for.
-  color = game.currentPlayer();
+  ChipColor color = m_turn;
   if (color == NoColor)
   {
       m_computingMove = false;
       return KReversiPos();
   }
 
+  m_root_colorbits    = ComputeOccupiedBits(color);
+  m_root_opponentbits = ComputeOccupiedBits(opponentColorFor(color));
+  m_root_key          = TranspositionTable::computeKey(ComputeOccupiedBits(Black),
+						       ComputeOccupiedBits(White),
+						       color);
+  m_root_color        = color;
+
   // Figure out the current score
-  m_score->set(White, game.playerScore(White));
-  m_score->set(Black, game.playerScore(Black));
+  m_score.set(color, bitCount(m_root_colorbits));
+  m_score.set(opponentColorFor(color), bitCount(m_root_opponentbits));
+
+  m_root_pieces = m_score.score(White) + m_score.score(Black);
 
   // Treat the first move as a special case (we can basically just
-  // pick a move at random).
-  if (m_score->score(White) + m_score->score(Black) == 4)
+  // pick a move at random).  This is only reached without an opening
+  // book, see bookMove().
+  if (m_root_pieces == 4)
   {
       m_computingMove = false;
-      return ComputeFirstMove(game);
+      return m_pondering ? KReversiPos() : ComputeFirstMove();
   }
 
-  // Let there be room for 3000 changes during the recursive search.
-  // This is more than will ever be needed.
-  m_squarestack.init(3000);
+  // When pondering, the search that is prepared for starts one move
+  // later, and the evaluation has to be the one it will use.
+  int pieces = m_pondering ? m_root_pieces + 1 : m_root_pieces;
 
   // Get the search depth.  If we are close to the end of the game,
   // the number of possible moves goes down, so we can search deeper
   // without using more time.
-  m_depth = m_strength;
-  if (m_score->score(White) + m_score->score(Black) + m_depth + 3 >= 64)
-    m_depth = 64 - m_score->score(White) - m_score->score(Black);
-  else if (m_score->score(White) + m_score->score(Black) + m_depth + 4 >= 64)
-    m_depth += 2;
-  else if (m_score->score(White) + m_score->score(Black) + m_depth + 5 >= 64)
-    m_depth++;
-
-  // If we are very close to the end, we can even make the search
-  // exhaustive.
-  if (m_score->score(White) + m_score->score(Black) + m_depth >= 64)
-    m_exhaustive = true;
+  m_max_depth = m_strength;
+  if (pieces + m_max_depth + 3 >= 64)
+    m_max_depth = 64 - pieces;
+  else if (pieces + m_max_depth + 4 >= 64)
+    m_max_depth += 2;
+  else if (pieces + m_max_depth + 5 >= 64)
+    m_max_depth++;
 
   // The evaluation is a linear combination of the score (number of
   // pieces) and the sum of the scores for the squares (given by
-  // m_bc_score).  The earlier in the game, the more we use the square
+  // m_bc_board).  The earlier in the game, the more we use the square
   // values and the later in the game the more we use the number of
-  // pieces.
-  m_coeff = 100 - (100*
-		   (m_score->score(White) + m_score->score(Black)
-		    + m_depth - 4)) / 60;
-
-  // Initialize the board that we use for the search.
-  for (uint x = 0; x < 10; x++)
-    for (uint y = 0; y < 10; y++) {
-      if (1 <= x && x <= 8
-      && 1 <= y && y <= 8)
-    m_board[x][y] = game.chipColorAt(y-1, x-1);
-      else
-    m_board[x][y] = NoColor;
-    }
-
-  // Initialize a lot of stuff that we will use in the search.
-
-  // Initialize m_bc_score to the current bc score.  This is kept
-  // up-to-date incrementally so that way we won't have to calculate
-  // it from scratch for each evaluation.
-  m_bc_score->set(White, CalcBcScore(White));
-  m_bc_score->set(Black, CalcBcScore(Black));
-
-  quint64 colorbits    = ComputeOccupiedBits(color);
-  quint64 opponentbits = ComputeOccupiedBits(opponentColorFor(color));
-
-  int maxval = -LARGEINT;
-  int max_x = 0;
-  int max_y = 0;
+  // pieces.  The depth asked for by the strength is used here, also
+  // when the time budget lets the search go deeper, so that all
+  // iterations evaluate in the same way and can share the
+  // transposition table.
+  m_coeff = 100 - (100 * (pieces + m_max_depth - 4)) / 60;
+
+  // The pattern evaluation takes the place of this, if it is there.
+  m_pattern_eval = sharedPatternEval();
+
+  // Selective search needs its parameters.
+  m_probcut = m_selectivity > 0 ? sharedProbCut() : 0;
+
+  // With a time budget, and when pondering, the depth is only limited
+  // by the end of the game.
+  if (m_time_budget > 0 || m_pondering)
+    m_max_depth = 64 - m_root_pieces;
+
+  m_first_depth = 1;
+
+  // The transposition table is only allocated when it is needed, since
+  // the Lua AI creates lots of short lived Engine objects.
+  if (!m_tt->isAllocated())
+    m_tt->resize(TT_MEGABYTES);
+
+  // The values in the table are only used by the search that stored
+  // them, since the evaluation changes from one move to the next.  A
+  // search that follows ponder() evaluates in the same way, though, and
+  // goes on with its values.
+  if (!m_pondered || m_coeff != m_ponder_coeff)
+    m_tt->newSearch();
+  m_pondered = false;
+
+  // Set up the helpers.
+  while (m_helpers.size() < m_threads - 1)
+    m_helpers.append(new Engine(m_strength));
+  while (m_helpers.size() > m_threads - 1)
+    delete m_helpers.takeLast();
+
+  QList<SearchThread*> threads;
+  for (int i = 0; i < m_helpers.size(); i++) {
+    Engine* helper = m_helpers[i];
+
+    helper->m_root_colorbits    = m_root_colorbits;
+    helper->m_root_opponentbits = m_root_opponentbits;
+    helper->m_root_key          = m_root_key;
+    helper->m_root_color        = m_root_color;
+    helper->m_root_pieces       = m_root_pieces;
+    helper->m_max_depth         = m_max_depth;
+    helper->m_coeff             = m_coeff;
+    helper->m_pattern_eval      = m_pattern_eval;
+    helper->m_probcut           = m_probcut;
+    helper->m_selectivity       = m_selectivity;
+    helper->m_strength          = m_strength;
+    helper->m_competitive       = true;
+    helper->m_time_budget       = 0;
+    helper->m_tt                = m_tt;
+    helper->m_helper_index      = i + 1;
+    helper->m_first_depth       = 1 + (i + 1) % 2;
+    helper->m_interrupt         = false;
+
+    threads.append(new SearchThread(helper));
+    threads.last()->start();
+  }
 
-  MoveAndValue moves[60];
-  int number_of_moves = 0;
-  int number_of_maxval = 0;
+  SearchIterations();
 
-  setInterrupt(false);
-
-  quint64 null_bits;
-  null_bits = 0;
-
-  // The main search loop.  Step through all possible moves and keep
-  // track of the most valuable one.  This move is stored in
-  // (max_x, max_y) and the value is stored in maxval.
-  m_nodes_searched = 0;
-  for (int x = 1; x < 9; x++) {
-    for (int y = 1; y < 9; y++) {
-      // Don't bother with non-empty squares and squares that aren't
-      // neighbors to opponent pieces.
-      if (m_board[x][y] != NoColor
-	  || (m_neighbor_bits[x][y] & opponentbits) == null_bits)
-	continue;
-
-
-      int val = ComputeMove2(x, y, color, 1, maxval,
-			     colorbits, opponentbits);
-
-      if (val != ILLEGAL_VALUE) {
-	moves[number_of_moves++].setXYV(x, y, val);
-
-	// If the move is better than all previous moves, then record
-	// this fact...
-	if (val > maxval) {
-
-	  // ...except that we want to make the computer miss some
-	  // good moves so that beginners can play against the program
-	  // and not always lose.  However, we only do this if the
-	  // user wants a casual game, which is set in the settings
-	  // dialog.
-	  int randi = m_random.getLong(7);
-	  if (maxval == -LARGEINT
-	      || m_competitive
-	      || randi < (int) m_strength) {
-	    maxval = val;
-	    max_x  = x;
-	    max_y  = y;
-
-	    number_of_maxval = 1;
-	  }
-	}
-	else if (val == maxval)
-	  number_of_maxval++;
-      }
-
-      // Jump out prematurely if interrupt is set.
-      if (interrupted())
-	break;
-    }
+  quint64 nodes = m_nodes_searched;
+  for (int i = 0; i < threads.size(); i++) {
+    m_helpers[i]->m_interrupt = true;
+    threads[i]->wait();
+    nodes += m_helpers[i]->m_nodes_searched;
+    delete threads[i];
   }
 
-  // long endtime = times(&tmsdummy);
-
   // If there are more than one best move, the pick one randomly.
+  int max_square = m_max_square;
+  int number_of_maxval = 0;
+  for (int i = 0; i < m_number_of_moves; ++i)
+    if (m_moves[i].m_value == m_maxval)
+      number_of_maxval++;
+
   if (number_of_maxval > 1) {
     int  r = m_random.getLong(number_of_maxval) + 1;
     int  i;
 
-    for (i = 0; i < number_of_moves; ++i) {
-      if (moves[i].m_value == maxval && --r <= 0)
+    for (i = 0; i < m_number_of_moves; ++i) {
+      if (m_moves[i].m_value == m_maxval && --r <= 0)
 	break;
     }
 
-    max_x = moves[i].m_x;
-    max_y = moves[i].m_y;
+    max_square = m_moves[i].m_x * 8 + m_moves[i].m_y;
+  }
+
+  // The principal variation only belongs to the move the search found.
+  if (max_square != m_max_square) {
+    m_root_pv[0] = max_square;
+    m_root_pv_length = 1;
   }
 
+  kDebug() << "nodes searched : " << nodes << " threads : " << m_threads;
+
   m_computingMove = false;
   // Return a suitable move.  
-  if (interrupted()) {
-    kDebug() << "computer computing move : INTERRUPTED";    
+  if (*m_cancel) {
+    kDebug() << "computer computing move : CANCELLED";    
     return KReversiPos(NoColor, -1, -1);
-  }else if (maxval != -LARGEINT){
-    kDebug() << "computer computing move : " << max_y-1 << " " << max_x-1;    
-    return KReversiPos(color, max_y-1, max_x-1);
+  }else if (m_maxval != -LARGEINT){
+    kDebug() << "computer computing move : " << max_square / 8 << " " << max_square % 8;    
+    return KReversiPos(color, max_square / 8, max_square % 8);
   }else{
     kDebug() << "computer computing move : NO MOVE";    
     return KReversiPos(NoColor, -1, -1);
@@ -779,14 +923,368 @@ KReversiPos Engine::computeMove(const KReversiGame& game, bool competitive)
 }
 
 
+// Search the position held by m_board on the time of the side to move
+// in it, until the search is cancelled (see setCancelFlag()).  The move
+// is of no interest, but the results that are left in the
+// transposition table are: the searchMove() that follows for the
+// position after the opponent's reply finds them ready, as long as it
+// is after one of the replies that were searched.  The engine
+// evaluates as it will in that search, from the piece count and
+// strength it will search with.
+//
+
+void Engine::ponder()
+{
+  int time_budget = m_time_budget;
+
+  m_time_budget = 0;
+  m_pondering   = true;
+  searchMove();
+  m_pondering   = false;
+  m_time_budget = time_budget;
+
+  m_pondered     = true;
+  m_ponder_coeff = m_coeff;
+}
+
+
+PosList Engine::principalVariation() const
+{
+  PosList   pv;
+  ChipColor color = m_root_color;
+
+  for (int i = 0; i < m_root_pv_length; i++) {
+    int square = m_root_pv[i];
+    if (square < 0)
+      pv.append(KReversiPos(color, -1, -1));
+    else
+      pv.append(KReversiPos(color, square / 8, square % 8));
+    color = opponentColorFor(color);
+  }
+
+  return pv;
+}
+
+
+// The iterative deepening loop of searchMove().  It searches the root
+// position given by the m_root_ members and leaves the values of the
+// root moves of the deepest completed iteration in m_moves, the best of
+// them in m_maxval and m_max_square, and its principal variation in
+// m_root_pv.
+//
+// Each iteration but the first searches with an aspiration window
+// around the value of the previous one, which will most likely contain
+// the new value too.  If it does not, the root is searched again with
+// the window opened to that side.
+//
+
+void Engine::SearchIterations()
+{
+  // Suppose that we should give a heuristic evaluation.  If we are
+  // close to the end of the game we can make an exhaustive search,
+  // but that case is determined further down.
+  m_exhaustive = false;
+  m_time_up = false;
+  m_hard_deadline = 0;
+  m_timer.start();
+
+  if (m_pattern_eval) {
+    if (m_root_color == Black)
+      m_features.setup(m_root_colorbits, m_root_opponentbits);
+    else
+      m_features.setup(m_root_opponentbits, m_root_colorbits);
+  }
+
+  m_ordering.newSearch();
+
+  m_nodes_searched  = 0;
+  m_number_of_moves = 0;
+  m_maxval          = -LARGEINT;
+  m_max_square      = -1;
+  m_root_pv_length  = 0;
+  m_iteration_values.clear();
+
+  for (m_depth = m_first_depth; m_depth <= m_max_depth; m_depth++) {
+    MoveAndValue  moves[60];
+    int           number_of_moves;
+    int           max_square;
+
+    // With a time budget and few enough empties, go for the exact result
+    // right away instead of deepening one ply at a time.
+    int empties = 64 - m_root_pieces;
+    if (m_time_budget > 0 && empties <= ENDGAME_SOLVER_EMPTIES
+	&& m_depth > ENDGAME_FALLBACK_DEPTH)
+      m_depth = empties;
+
+    // If we are very close to the end, we can even make the search
+    // exhaustive.  Values from such a search are final scores, so they
+    // are kept apart from the heuristic ones in the transposition table.
+    m_exhaustive = m_root_pieces + m_depth >= 64;
+    quint64 key  = m_root_key;
+    if (m_exhaustive)
+      key ^= TranspositionTable::exhaustiveKey();
+
+    // Exhaustive values are final scores, which would fall out of any
+    // window around a heuristic value.
+    int alpha = -LARGEINT;
+    int beta  = LARGEINT;
+    if (m_number_of_moves > 0 && !m_exhaustive) {
+      alpha = qMax(m_maxval - ASPIRATION_WINDOW, -LARGEINT);
+      beta  = qMin(m_maxval + ASPIRATION_WINDOW, LARGEINT);
+    }
+
+    int val;
+    int first_square = m_max_square;
+    for (;;) {
+      val = SearchRoot(m_root_color, m_root_colorbits, m_root_opponentbits,
+		       key, first_square, alpha, beta,
+		       moves, number_of_moves, max_square);
+
+      if (stopped())
+	break;
+
+      if (val <= alpha && alpha > -LARGEINT)
+	alpha = -LARGEINT;
+      else if (val >= beta && beta < LARGEINT) {
+	beta = LARGEINT;
+	first_square = max_square;
+      }
+      else
+	break;
+    }
+
+    if (stopped())
+      break;
+
+    m_maxval          = val;
+    m_max_square      = max_square;
+    m_number_of_moves = number_of_moves;
+    for (int i = 0; i < number_of_moves; i++)
+      m_moves[i] = moves[i];
+
+    m_root_pv_length = m_pv_length[0];
+    for (int i = 0; i < m_pv_length[0]; i++)
+      m_root_pv[i] = m_pv[0][i];
+
+    if (!m_exhaustive)
+      m_iteration_values.append(m_maxval);
+
+#ifndef KDE_NO_DEBUG_OUTPUT
+    // The PV is written to a buffer on the stack, so that an iteration
+    // only allocates for the debug output itself.
+    if (m_helper_index == 0) {
+      char  pv[2 * MAX_PV_LENGTH + 1];
+      char *p = pv;
+      for (int i = 0; i < m_root_pv_length; i++) {
+	int square = m_root_pv[i];
+	*p++ = square < 0 ? '-' : 'a' + square % 8;
+	*p++ = square < 0 ? '-' : '1' + square / 8;
+      }
+      *p = '\0';
+
+      kDebug() << "depth : " << m_depth << " value : " << m_maxval
+	       << " nodes searched : " << m_nodes_searched
+	       << " time : " << m_timer.elapsed()
+	       << " pv : " << pv;
+    }
+#endif
+
+    // The whole game has been searched.
+    if (m_exhaustive)
+      break;
+
+    if (m_time_budget > 0) {
+      // Do not start another iteration after the soft deadline.
+      if (m_timer.elapsed() >= m_time_budget / 2)
+	break;
+
+      // Now that there is a move to fall back to, the next iterations
+      // may be abandoned when the budget is used up.
+      m_hard_deadline = m_time_budget;
+    }
+  }
+}
+
+
+// Search all moves of the root position to depth m_depth.  first_square
+// is searched first if it is a legal move.  The values of the legal
+// moves are stored in moves, and the best of them is returned together
+// with its square in max_square.  Its principal variation is left in
+// m_pv[0].
+//
+// The value returned is only exact if it lies between alpha and beta.
+// Otherwise it is an upper bound (if it is at most alpha) or a lower
+// bound (if it is at least beta), and the search has to be repeated
+// with a wider window.
+//
+// The first move is searched with the full window, and the others with
+// a null window just below the best value so far, which only tells
+// whether they are at least as good.  Those that are get searched again
+// to find their real value.  Moves as good as the best one thus get
+// exact values too, so that the choice among equal moves stays random.
+//
+
+int Engine::SearchRoot(ChipColor color, quint64 colorbits,
+		       quint64 opponentbits, quint64 key, int first_square,
+		       int alpha, int beta,
+		       MoveAndValue* moves, int& number_of_moves,
+		       int& max_square)
+{
+  int maxval = -LARGEINT;
+  max_square = -1;
+  number_of_moves = 0;
+  m_pv_length[0] = 0;
+
+  // Order the moves by the values they got in the previous iteration,
+  // if there was one, and by m_ordering otherwise and among equal values.
+  // All but the best of these values are only upper bounds, but a move
+  // that was refuted by little is still more likely to be best now than
+  // one that was refuted by a lot.
+  int squares[64];
+  int count = m_ordering.orderMoves(color, 0, colorbits, opponentbits,
+				    first_square, true, squares);
+  if (count == 0 || squares[0] != first_square)
+    first_square = -1;
+
+  if (m_number_of_moves > 0) {
+    int values[64];
+    for (int i = 0; i < count; i++) {
+      int square = squares[i];
+      int value  = -LARGEINT;
+      for (int j = 0; j < m_number_of_moves; j++)
+	if (m_moves[j].m_x * 8 + m_moves[j].m_y == square)
+	  value = m_moves[j].m_value;
+
+      int k = i;
+      for (; k > 0 && values[k - 1] < value; k--) {
+	squares[k] = squares[k - 1];
+	values[k]  = values[k - 1];
+      }
+      squares[k] = square;
+      values[k]  = value;
+    }
+  }
+
+  // first_square is searched first in any case.  Without it, let each
+  // helper start with a move of its own, so that they do not all search
+  // the same subtree at the same time.
+  int first = -1;
+  for (int i = 0; i < count; i++)
+    if (squares[i] == first_square)
+      first = i;
+  if (first < 0 && count > 0 && m_helper_index > 0)
+    first = m_helper_index % count;
+
+  for (; first > 0; first--)
+    qSwap(squares[first], squares[first - 1]);
+
+  // Step through all legal moves and keep track of the most valuable
+  // one.
+  for (int i = 0; i < count; i++) {
+    int square = squares[i];
+    int val;
+    if (m_exhaustive) {
+      val = SolveMove(square, colorbits, opponentbits, maxval);
+      m_pv_length[1] = 0;
+    }
+    else if (maxval == -LARGEINT)
+      val = ComputeMove2(square, color, 1, alpha, beta, colorbits,
+			 opponentbits, key);
+    else {
+      int lower = maxval > alpha ? maxval - 1 : alpha;
+
+      val = ComputeMove2(square, color, 1, lower, lower + 1, colorbits,
+			 opponentbits, key);
+      if (val != ILLEGAL_VALUE && val > lower && val < beta)
+	val = ComputeMove2(square, color, 1, lower, beta, colorbits,
+			   opponentbits, key);
+    }
+
+    if (val != ILLEGAL_VALUE) {
+      moves[number_of_moves++].setXYV(square / 8, square % 8, val);
+
+      // If the move is better than all previous moves, then record
+      // this fact...
+      if (val > maxval) {
+
+	// ...except that we want to make the computer miss some
+	// good moves so that beginners can play against the program
+	// and not always lose.  However, we only do this if the
+	// user wants a casual game, which is set in the settings
+	// dialog.
+	int randi = m_random.getLong(7);
+	if (maxval == -LARGEINT
+	    || m_competitive
+	    || randi < (int) m_strength) {
+	  maxval = val;
+	  max_square = square;
+	  UpdatePV(0, square);
+	}
+      }
+    }
+
+    // Jump out prematurely if the search is cancelled or time is up, or if
+    // the window has to be widened anyway.
+    if (stopped() || maxval >= beta)
+      break;
+  }
+
+  return maxval;
+}
+
+
+// Compute the exact final score of the move at square with the endgame
+// solver.  The score is only exact if it is at least maxval; moves that
+// cannot reach maxval just get a value below it.
+//
+
+int Engine::SolveMove(int square, quint64 colorbits, quint64 opponentbits,
+		      int maxval)
+{
+  quint64 flipped = flippedBits(square, colorbits, opponentbits);
+  if (flipped == 0)
+    return ILLEGAL_VALUE;
+
+  colorbits    |= flipped | squareBit(square);
+  opponentbits &= ~flipped;
+
+  m_solver.setTable(m_tt);
+  m_solver.setInterrupt(m_cancel, &m_timer, m_hard_deadline);
+
+  // Find out with a null window whether the move reaches maxval at all,
+  // and only then compute its exact score.  Moves that are as good as
+  // the best one so far must get their exact score too, so that the
+  // choice among equal moves stays random.
+  int val;
+  if (maxval == -LARGEINT)
+    val = -m_solver.solve(opponentbits, colorbits, -65, 65);
+  else {
+    val = -m_solver.solve(opponentbits, colorbits, -maxval, 1 - maxval);
+    if (val >= maxval && !m_solver.stopped()) {
+      quint64 null_window_nodes = m_solver.nodes();
+      val = -m_solver.solve(opponentbits, colorbits, -65, 1 - maxval);
+      m_nodes_searched += null_window_nodes;
+    }
+  }
+
+  m_nodes_searched += m_solver.nodes();
+  if (m_solver.stopped()) {
+    m_time_up = true;
+    return ILLEGAL_VALUE;
+  }
+
+  return val;
+}
+
+
 // Get the first move.  We can pick any move at random.
 //
 
-KReversiPos Engine::ComputeFirstMove(const KReversiGame& game)
+KReversiPos Engine::ComputeFirstMove()
 {
   kDebug() << "compute first move called";
   int    r;
-  ChipColor  color = game.currentPlayer();
+  ChipColor  color = m_turn;
 
   r = m_random.getLong(4) + 1;
 
@@ -805,123 +1303,102 @@ KReversiPos Engine::ComputeFirstMove(const KReversiGame& game)
 }
 
 
-// Play a move at (xplay, yplay) and generate a value for it.  If we
-// are at the maximum search depth, we get the value by calling
-// EvaluatePosition(), otherwise we get it by performing an alphabeta
-// search.
+// Play a move at square and generate a value for it.  If we are at the
+// maximum search depth, we get the value by calling EvaluateBits(),
+// otherwise we get it by performing an alphabeta search.
+//
+// colorbits holds the pieces of color, the side that makes the move,
+// and opponentbits those of the other side.  key is the Zobrist key of
+// the position before the move.  alpha and beta are the window of the
+// search, as seen by color (see TryAllMoves()).  The principal variation
+// after the move is left in m_pv[level].
 //
 
-int Engine::ComputeMove2(int xplay, int yplay, ChipColor color, int level,
-			 int cutoffval, quint64 colorbits,
-			 quint64 opponentbits)
+int Engine::ComputeMove2(int square, ChipColor color, int level,
+			 int alpha, int beta, quint64 colorbits,
+			 quint64 opponentbits, quint64 key)
 {
-  int               number_of_turned = 0;
-  SquareStackEntry  mse;
-  ChipColor                 opponent = opponentColorFor(color);
-
-  m_nodes_searched++;
-
-  // Put the piece on the board and incrementally update scores and bitmaps.
-  m_board[xplay][yplay] = color;
-  colorbits |= m_coord_bit[xplay][yplay];
-  m_score->inc(color);
-  m_bc_score->add(color, m_bc_board[xplay][yplay]);
-
-  // Loop through all 8 directions and turn the pieces that can be turned.
-  for (int xinc = -1; xinc <= 1; xinc++)
-    for (int yinc = -1; yinc <= 1; yinc++) {
-      if (xinc == 0 && yinc == 0)
-	continue;
-
-      int x, y;
-
-      for (x = xplay + xinc, y = yplay + yinc; m_board[x][y] == opponent;
-	   x += xinc, y += yinc)
-	;
-
-      // If we found the end of a turnable row, then go back and turn
-      // all pieces on the way back.  Also push the squares with
-      // turned pieces on the squarestack so that we can undo the move
-      // later.
-      if (m_board[x][y] == color)
-	for (x -= xinc, y -= yinc; x != xplay || y != yplay;
-	     x -= xinc, y -= yinc) {
-	  m_board[x][y] = color;
-	  colorbits |= m_coord_bit[x][y];
-	  opponentbits &= ~m_coord_bit[x][y];
-
-	  m_squarestack.Push(x, y);
-
-	  m_bc_score->add(color, m_bc_board[x][y]);
-	  m_bc_score->sub(opponent, m_bc_board[x][y]);
-	  number_of_turned++;
-	}
-    }
+  ChipColor  opponent = opponentColorFor(color);
 
-  int retval = -LARGEINT;
+  // Find the pieces that are turned.  If there are none, the move is
+  // illegal.
+  quint64 flipped = flippedBits(square, colorbits, opponentbits);
+  if (flipped == 0)
+    return ILLEGAL_VALUE;
 
-  // If we managed to turn at least one piece, then (xplay, yplay) was
-  // a legal move.  Now find out the value of the move.
-  if (number_of_turned > 0) {
+  // Look at the clock every now and then.
+  if ((++m_nodes_searched & 1023) == 0 && m_hard_deadline > 0
+      && m_timer.elapsed() >= m_hard_deadline)
+    m_time_up = true;
 
-    // First adjust the number of pieces for each side.
-    m_score->add(color, number_of_turned);
-    m_score->sub(opponent, number_of_turned);
+  // Put the piece on the board and turn the pieces, and update the key
+  // accordingly.  The caller keeps its own copy of the masks and the key,
+  // so there is nothing to undo afterwards.
+  colorbits    |= flipped | squareBit(square);
+  opponentbits &= ~flipped;
 
-    // If we are at the bottom of the search, get the evaluation.
-    if (level >= m_depth)
-      retval = EvaluatePosition(color); // Terminal node
-    else {
-      int maxval = TryAllMoves(opponent, level, cutoffval, opponentbits,
-			       colorbits);
+  key ^= TranspositionTable::squareKey(color, square)
+    ^ TranspositionTable::sideKey();
+  for (quint64 bits = flipped; bits; bits &= bits - 1)
+    key ^= TranspositionTable::flipKey(firstBit(bits));
 
-      if (maxval != -LARGEINT)
-	retval = -maxval;
-      else {
+  // The patterns are updated in the same way, but they are shared by the
+  // whole search, so they have to be restored below.
+  bool patterns = m_pattern_eval != 0 && !m_exhaustive;
+  if (patterns)
+    m_features.makeMove(color, square, flipped);
+
+  int retval = -LARGEINT;
+  m_pv_length[level] = 0;
+
+  // If we are at the bottom of the search, get the evaluation.
+  if (level >= m_depth)
+    retval = EvaluateBits(color, colorbits, opponentbits); // Terminal node
+  else {
+    int maxval = TryAllMoves(opponent, level, -beta, -alpha, opponentbits,
+			     colorbits, key);
+
+    if (maxval != -LARGEINT)
+      retval = -maxval;
+    else {
 
-	// No possible move for the opponent, it is colors turn again:
-	retval = TryAllMoves(color, level, -LARGEINT, colorbits, opponentbits);
+      // No possible move for the opponent, it is colors turn again:
+      retval = TryAllMoves(color, level, alpha, beta, colorbits, opponentbits,
+			   key ^ TranspositionTable::sideKey());
 
-	if (retval == -LARGEINT) {
+      if (retval != -LARGEINT) {
+	int length = qMin(m_pv_length[level], MAX_PV_LENGTH - 1);
+	for (int i = length; i > 0; i--)
+	  m_pv[level][i] = m_pv[level][i - 1];
+	m_pv[level][0] = -1;
+	m_pv_length[level] = length + 1;
+      }
+      else {
 
-	  // No possible move for anybody => end of game:
-	  int finalscore = m_score->score(color) - m_score->score(opponent);
+	// No possible move for anybody => end of game:
+	int finalscore = bitCount(colorbits) - bitCount(opponentbits);
 
-	  if (m_exhaustive)
-	    retval = finalscore;
-	  else {
-	    // Take a sure win and avoid a sure loss (may not be optimal):
+	if (m_exhaustive)
+	  retval = finalscore;
+	else {
+	  // Take a sure win and avoid a sure loss (may not be optimal):
 
-	    if (finalscore > 0)
-	      retval = LARGEINT - 65 + finalscore;
-	    else if (finalscore < 0)
-	      retval = -(LARGEINT - 65 + finalscore);
-	    else
-	      retval = 0;
-	  }
+	  if (finalscore > 0)
+	    retval = LARGEINT - 65 + finalscore;
+	  else if (finalscore < 0)
+	    retval = -(LARGEINT - 65 + finalscore);
+	  else
+	    retval = 0;
 	}
       }
     }
-
-    m_score->add(opponent, number_of_turned);
-    m_score->sub(color, number_of_turned);
   }
 
-  // Undo the move.  Start by unturning the turned pieces.
-  for (int i = number_of_turned; i > 0; i--) {
-    mse = m_squarestack.Pop();
-    m_bc_score->add(opponent, m_bc_board[mse.m_x][mse.m_y]);
-    m_bc_score->sub(color, m_bc_board[mse.m_x][mse.m_y]);
-    m_board[mse.m_x][mse.m_y] = opponent;
-  }
-
-  // Now remove the new piece that we put down.
-  m_board[xplay][yplay] = NoColor;
-  m_score->sub(color, 1);
-  m_bc_score->sub(color, m_bc_board[xplay][yplay]);
+  if (patterns)
+    m_features.unmakeMove(color, square, flipped);
 
   // Return a suitable value.
-  if (number_of_turned < 1 || interrupted())
+  if (stopped())
     return ILLEGAL_VALUE;
   else
     return retval;
@@ -929,159 +1406,258 @@ int Engine::ComputeMove2(int xplay, int yplay, ChipColor color, int level,
 
 // Generate all legal moves from the current position, and do a search
 // to see the value of them.  This function returns the value of the
-// most valuable move, but not the move itself.
+// most valuable move, but not the move itself.  colorbits holds the
+// pieces of color, the side to move, and key is the Zobrist key of the
+// position.  The principal variation is left in m_pv[level].
+//
+// The value is only searched for within the window between alpha and
+// beta.  If it is at most alpha, the returned value is an upper bound,
+// and the moves are not worth looking into any further.  As soon as a
+// move reaches beta, the other moves are cut off and the returned value
+// is a lower bound.  Values in between are exact.  All three kinds are
+// kept in the transposition table.
+//
+// Only the first move, the one most likely to be best, is searched with
+// the whole window (principal variation search).  The other moves are
+// searched with a null window just above alpha, which is much cheaper
+// and only tells whether they are better than the best move so far.
+// The few that are get searched again with the whole window.
 //
 
-int Engine::TryAllMoves(ChipColor opponent, int level, int cutoffval,
-			quint64 opponentbits, quint64 colorbits)
+int Engine::TryAllMoves(ChipColor color, int level, int alpha, int beta,
+			quint64 colorbits, quint64 opponentbits, quint64 key)
 {
   int maxval = -LARGEINT;
+  int max_square = -1;
+  int depth = m_depth - level;
 
-  // Keep GUI alive by calling the event loop.
-  yield();
+  m_pv_length[level] = 0;
 
-  quint64  null_bits;
-  null_bits = 0;
+  quint64 legal = legalMoveBits(colorbits, opponentbits);
+  if (legal == 0)
+    return -LARGEINT;
 
-  for (int x = 1; x < 9; x++) {
-    for (int y = 1; y < 9; y++) {
-      if (m_board[x][y] == NoColor && (m_neighbor_bits[x][y] & colorbits) != null_bits) {
-        int val = ComputeMove2(x, y, opponent, level+1, maxval, opponentbits,
-			       colorbits);
+  // Use what an earlier search found out about this position.  Nodes
+  // with a full window are still searched, though, so that their
+  // principal variation is complete; there are few of them.
+  int hint = -1;
+  TTEntry entry;
+  if (m_tt->probe(key, entry)) {
+    if (m_tt->isCurrent(entry) && entry.m_depth >= depth
+	&& beta - alpha == 1) {
+      if (entry.m_bound == TranspositionTable::ExactBound)
+	return entry.m_value;
+      if (entry.m_bound == TranspositionTable::LowerBound
+	  && entry.m_value >= beta)
+	return entry.m_value;
+      if (entry.m_bound == TranspositionTable::UpperBound
+	  && entry.m_value <= alpha)
+	return entry.m_value;
+    }
 
-        if (val != ILLEGAL_VALUE && val > maxval) {
-            maxval = val;
-            if (maxval > -cutoffval || interrupted())
-                break;
-        }
+    if (entry.m_move >= 0 && (legal & squareBit(entry.m_move)))
+      hint = entry.m_move;
+  }
+
+  // Nodes with a null window may be cut off by Multi-ProbCut.
+  int value;
+  if (m_probcut && beta - alpha == 1 && depth >= ProbCut::MIN_DEPTH
+      && !m_exhaustive && !m_in_probcut
+      && ProbCutTest(color, level, alpha, beta, colorbits, opponentbits,
+		     key, value))
+    return value;
+
+  // Try the best move from the transposition table first, and then the
+  // others in the order of m_ordering.
+  int squares[64];
+  int number_of_moves = m_ordering.orderMoves(color, level, colorbits,
+					      opponentbits, hint,
+					      depth >= MOBILITY_ORDER_DEPTH,
+					      squares);
+
+  int  lower = alpha;
+  bool cutoff = false;
+  for (int i = 0; i < number_of_moves; i++) {
+    int square = squares[i];
+    int val;
+
+    if (i == 0)
+      val = ComputeMove2(square, color, level+1, lower, beta, colorbits,
+			 opponentbits, key);
+    else {
+      val = ComputeMove2(square, color, level+1, lower, lower + 1,
+			 colorbits, opponentbits, key);
+      if (val != ILLEGAL_VALUE && val > lower && val < beta)
+	val = ComputeMove2(square, color, level+1, lower, beta, colorbits,
+			   opponentbits, key);
+    }
+
+    if (val != ILLEGAL_VALUE && val > maxval) {
+      maxval = val;
+      max_square = square;
+      if (maxval >= beta) {
+	m_ordering.addCutoff(color, level, square, depth);
+	cutoff = true;
+	break;
+      }
+      if (maxval > lower) {
+	lower = maxval;
+	UpdatePV(level, square);
       }
     }
 
-    if (maxval > -cutoffval || interrupted())
+    if (stopped())
       break;
   }
 
-  if (interrupted())
+  if (stopped())
     return -LARGEINT;
 
+  TranspositionTable::Bound bound = TranspositionTable::ExactBound;
+  if (cutoff)
+    bound = TranspositionTable::LowerBound;
+  else if (maxval <= alpha)
+    bound = TranspositionTable::UpperBound;
+  m_tt->store(key, maxval, depth, bound, max_square);
+
   return maxval;
 }
 
 
-// Calculate a heuristic value for the current position.  If we are at
-// the end of the game, do this by counting the pieces.  Otherwise do
-// it by combining the score using the number of pieces, and the score
-// using the board control values.
+// Multi-ProbCut: try to predict from shallow searches whether the value
+// of the position is very likely beyond the window of alpha and beta,
+// and return true with the bound it is beyond in value if so.
+//
+// For each pair of the remaining depth and a shallow depth (see
+// ProbCut.h), the shallow search is done with a null window at the
+// shallow value that predicts the deep value to clear beta (or alpha) by
+// the margin the selectivity asks for.  That is much cheaper than
+// searching to the full depth, so the nodes that are not cut off do not
+// cost much more.
 //
 
-int Engine::EvaluatePosition(ChipColor color)
+bool Engine::ProbCutTest(ChipColor color, int level, int alpha, int beta,
+			 quint64 colorbits, quint64 opponentbits, quint64 key,
+			 int& value)
 {
-  int retval;
+  if (beta > PROBCUT_MAX_VALUE || alpha < -PROBCUT_MAX_VALUE)
+    return false;
 
-  ChipColor opponent = opponentColorFor(color);
+  int count;
+  const ProbCutPair* pairs = m_probcut->pairs(bitCount(colorbits | opponentbits),
+					      m_depth - level, count);
 
-  int    score_color    = m_score->score(color);
-  int    score_opponent = m_score->score(opponent);
+  int  depth = m_depth;
+  bool cut   = false;
+  m_in_probcut = true;
 
-  if (m_exhaustive)
-    retval = score_color - score_opponent;
-  else {
-    retval = (100-m_coeff) *
-      (m_score->score(color) - m_score->score(opponent))
-      + m_coeff * BC_WEIGHT * (m_bc_score->score(color)
-			       - m_bc_score->score(opponent));
+  for (int i = 0; i < count && !cut && !stopped(); i++) {
+    const ProbCutPair& pair = pairs[i];
+    double margin = pair.m_sigma * PROBCUT_THRESHOLD[m_selectivity] / 100.0;
+
+    // The shallow search is an ordinary search of the position, with
+    // the depth cut short.
+    m_depth = level + pair.m_shallow_depth;
+
+    int bound = int(ceil((beta + margin - pair.m_intercept) / pair.m_slope));
+    if (bound < PROBCUT_MAX_VALUE
+	&& TryAllMoves(color, level, bound - 1, bound, colorbits,
+		       opponentbits, key) >= bound) {
+      value = beta;
+      cut   = true;
+      break;
+    }
+
+    bound = int(floor((alpha - margin - pair.m_intercept) / pair.m_slope));
+    if (bound > -PROBCUT_MAX_VALUE
+	&& TryAllMoves(color, level, bound, bound + 1, colorbits,
+		       opponentbits, key) <= bound) {
+      value = alpha;
+      cut   = true;
+    }
   }
 
-  return retval;
+  m_depth      = depth;
+  m_in_probcut = false;
+
+  return cut && !stopped();
 }
 
-// Calculate bitmaps for each square, and also for neighbors of each
-// square.
+
+// Make the principal variation at level the move at square followed by
+// the principal variation after it.
 //
 
-void Engine::SetupBits()
+void Engine::UpdatePV(int level, int square)
 {
-  //m_coord_bit = new long[9][9];
-  //m_neighbor_bits = new long[9][9];
-
-  quint64 bits = 1;
-
-  // Store a 64 bit unsigned it with the corresponding bit set for
-  // each square.
-  for (int i=1; i < 9; i++)
-    for (int j=1; j < 9; j++) {
-      m_coord_bit[i][j] = bits;
-      bits *= 2;
-    }
+  int length = qMin(m_pv_length[level + 1], MAX_PV_LENGTH - 1);
 
-  // Store a bitmap consisting of all neighbors for each square.
-  for (int i=1; i < 9; i++)
-    for (int j=1; j < 9; j++) {
-      m_neighbor_bits[i][j] = 0;
-
-      for (int xinc=-1; xinc<=1; xinc++)
-	for (int yinc=-1; yinc<=1; yinc++) {
-	  if (xinc != 0 || yinc != 0)
-	    if (i + xinc > 0 && i + xinc < 9 && j + yinc > 0 && j + yinc < 9)
-	      m_neighbor_bits[i][j] |= m_coord_bit[i + xinc][j + yinc];
-	}
-    }
+  m_pv[level][0] = square;
+  for (int i = 0; i < length; i++)
+    m_pv[level][i + 1] = m_pv[level + 1][i];
+  m_pv_length[level] = length + 1;
 }
 
 
-// Set up the board control values that will be used in evaluation of
-// the position.
-// static
-void Engine::SetupBcBoard()
+// Calculate a heuristic value for the current position.  If we are at
+// the end of the game, do this by counting the pieces.  Otherwise do
+// it by combining the score using the number of pieces, and the score
+// using the board control values, the mobility and the frontier of both
+// sides (see positionalScoreBits()).
+//
+
+int Engine::EvaluatePosition(ChipColor color)
 {
-  // JAVA m_bc_board = new int[9][9];
+  int retval;
 
-    //test if we should setup the bc board again
-    if(m_bc_board[7][8] == -1)
-        return;
+  ChipColor opponent = opponentColorFor(color);
 
-  for (int i=1; i < 9; i++)
-    for (int j=1; j < 9; j++) {
-      if (i == 2 || i == 7)
-	m_bc_board[i][j] = -1;
-      else
-	m_bc_board[i][j] = 0;
+  int    score_color    = m_score.score(color);
+  int    score_opponent = m_score.score(opponent);
 
-      if (j == 2 || j == 7)
-	m_bc_board[i][j] -= 1;
-    }
+  if (m_exhaustive)
+    retval = score_color - score_opponent;
+  else {
+    retval = (100-m_coeff) *
+      (m_score.score(color) - m_score.score(opponent))
+      + m_coeff * positionalScoreBits(ComputeOccupiedBits(color),
+				      ComputeOccupiedBits(opponent));
+  }
 
-  m_bc_board[1][1] = 2;
-  m_bc_board[8][1] = 2;
-  m_bc_board[1][8] = 2;
-  m_bc_board[8][8] = 2;
-
-  m_bc_board[1][2] = -1;
-  m_bc_board[2][1] = -1;
-  m_bc_board[1][7] = -1;
-  m_bc_board[7][1] = -1;
-  m_bc_board[8][2] = -1;
-  m_bc_board[2][8] = -1;
-  m_bc_board[8][7] = -1;
-  m_bc_board[7][8] = -1;
+  return retval;
 }
 
-
-// Calculate the board control .
+// Same as EvaluatePosition(), but for the position given by the masks
+// used during the search.  colorbits holds the pieces of color, the side
+// to evaluate for.  With the pattern evaluation, m_features must belong
+// to the position.
 //
 
-int Engine::CalcBcScore(ChipColor color)
+int Engine::EvaluateBits(ChipColor color, quint64 colorbits,
+			 quint64 opponentbits)
 {
-  int sum = 0;
+  int retval;
 
-  for (int i=1; i < 9; i++)
-    for (int j=1; j < 9; j++)
-      if (m_board[i][j] == color)
-	sum += m_bc_board[i][j];
+  int    score_diff = bitCount(colorbits) - bitCount(opponentbits);
 
-  return sum;
-}
+  if (m_exhaustive)
+    retval = score_diff;
+  else if (m_pattern_eval) {
+    if (color == Black)
+      retval = m_pattern_eval->evaluate(m_features, colorbits, opponentbits);
+    else
+      retval = -m_pattern_eval->evaluate(m_features, opponentbits, colorbits);
 
+    // Stay below the values of sure wins and losses.
+    retval = qBound(-(LARGEINT - 65), retval, LARGEINT - 65);
+  }
+  else {
+    retval = (100-m_coeff) * score_diff
+      + m_coeff * positionalScoreBits(colorbits, opponentbits);
+  }
+
+  return retval;
+}
 
 // Calculate a bitmap of the occupied squares for a certain color.
 //
@@ -1092,7 +1668,7 @@ quint64 Engine::ComputeOccupiedBits(ChipColor color)
 
   for (int i=1; i < 9; i++)
     for (int j=1; j < 9; j++)
-      if (m_board[i][j] == color) retval |= m_coord_bit[i][j];
+      if (m_board[i][j] == color) retval |= squareBit((i - 1) * 8 + j - 1);
 
   return retval;
 }
@@ -72,45 +72,91 @@
 // next to a corner is not very good and they give a lower value. In the
 // beginning of a game it is more important to have pieces on "good" squares,
 // but towards the end the total number of pieces of each color is given a
-// higher weight. Other things, like how many legal moves that can be made in a
-// position, and the number of pieces that can never be turned would probably
-// make the program stronger if they were considered in evaluating a position,
-// but that would make things more complicated (this was meant to be very
-// simple example) and would also slow down computation (considerably?).
+// higher weight. How many legal moves each side can make in the position
+// (the mobility) and how many of its pieces are next to empty squares (the
+// frontier, which gives the opponent moves) are weighted like the squares.
+// Counting moves square by square would slow down computation considerably,
+// but on the masks described below both are found for the whole board with
+// a few shifts (see positionalScoreBits() in Bitboard.h). The number of
+// pieces that can never be turned would probably make the program stronger
+// too, but that is left out to keep things simple.
 //
-// The member m_board[10][10]) holds the current position during the
-// computation. It is initiated at the start of ComputeMove() and
-// every move that is made during the search is made on this board. It should
-// be noted that 1 to 8 is used for the actual board, but 0 and 9 can be
-// used too (they are always empty). This is practical when turning pieces
-// when moves are made on the board. Every piece that is put on the board
-// or turned is saved in the stack m_squarestack (see class SquareStack) so
-// every move can easily be reversed after the search in a node is completed.
+// The member m_board[10][10] holds the current position as it was handed
+// over from the game. It should be noted that 1 to 8 is used for the actual
+// board, but 0 and 9 can be used too (they are always empty). The search
+// itself does not use m_board. Before it starts, the position is converted
+// to two 64 bit masks, one for each color (see Bitboard.h), and every node
+// of the search tree works on such a pair of masks. Legal moves are then
+// generated for all squares at once with a few shifts and masks, and a
+// move is made by or'ing in the new piece and the turned pieces. Since the
+// masks are passed by value, a move is taken back simply by returning to
+// the caller, so nothing has to be saved on the way down.
 //
-// The member m_bc_board[][] holds board control values for each square
-// and is initiated by a call to the function private void SetupBcBoard()
-// from Engines constructor. It is used in evaluation of positions except
-// when the game tree is searched all the way to the end of the game.
+// The member m_bc_board[][] holds board control values for each square.
+// It is a constant table, like dcol[] and drow[], so no engine has to set
+// it up and the compiler may fold its values. It is used in evaluation of
+// positions except when the game tree is searched all the way to the end
+// of the game. The search sums the values with the masks in Bitboard.h,
+// which group the squares of m_bc_board by value.
 //
-// The two members m_coord_bit[9][9] and m_neighbor_bits[9][9] are used to
-// speed up the tree search. This goes against the principle of keeping things
-// simple, but to understand the program you do not need to understand them
-// at all. They are there to make it possible to throw away moves where
-// the piece that is played is not adjacent to a piece of opposite color
-// at an early stage (because they could never be legal). It should be
-// pointed out that not all moves that pass this test are legal, there will
-// just be fewer moves that have to be tested in a more time consuming way.
+// Square (i, j) of m_board is bit (i - 1) * 8 + j - 1 of the masks.
+// Nothing of this is held per engine, so constructing one costs no more
+// than setting up its members.
 //
-// There are also two other members that should be mentioned: Score m_score
-// and Score m_bc_score. They hold the number of pieces of each color and
-// the sum of the board control values for each color during the search
-// (this is faster than counting at every leaf node).
+// Along with the masks, every node gets the Zobrist key of its position
+// (see TranspositionTable.h), which is updated with a few XORs when a
+// piece is put down or turned. TryAllMoves() looks the key up in the
+// transposition table m_tt before it searches a position. If the position
+// has already been searched deep enough, the stored value is used
+// directly, otherwise the stored best move is at least tried first.
+// The other moves are tried in the order m_ordering (see MoveOrdering.h)
+// gives them, which puts the moves that refuted similar positions before
+// the rest. At the root, the moves are tried in the order of their values
+// from the previous iteration.
 //
-
-// The classes SquareStackEntry and SquareStack implement a
-// stack that is used by Engine to store pieces that are turned during
-// searching (see ComputeMove()).
+// Since the first move is then usually the best, only it is searched with
+// the full alpha-beta window. The other moves are first searched with a
+// null window, which only tells whether they are better, and searched
+// again if they are (principal variation search). Along the way, the
+// search collects the principal variation, the line of play it expects,
+// which principalVariation() returns.
+//
+// If a file with pattern weights is installed (see PatternEval.h), the
+// linear evaluation is replaced by m_pattern_eval, which looks up
+// weights for the contents of the edges, corners and diagonals, and also
+// considers the mobility of both sides. The search keeps the indices of
+// the patterns in m_features up to date as it makes and takes back
+// moves, so an evaluation only has to add up a few dozen weights.
+//
+// Before any of this, the AI asks bookMove() for a move of the opening
+// book (see OpeningBook.h), if one is installed. Well known openings are
+// then played at once instead of being searched again every game.
+//
+// When the search would reach the end of the game, the root moves are
+// instead handed to m_solver (see EndgameSolver.h), which computes their
+// exact final scores much faster than the general search. With a time
+// budget and at most 16 empty squares left, the search goes for the exact
+// scores as soon as it has a move to fall back to.
+//
+// searchMove() searches in the thread that calls it, which in the game
+// is never the GUI thread (see AiWorker). Only the helpers of a search
+// with several threads (Lazy SMP) run in SearchThreads of their own. Each
+// helper has its own Engine, so nothing but the transposition table is
+// shared.
+//
+// There is also another member that should be mentioned: Score m_score.
+// It holds the number of pieces of each color in the position the engine
+// was set up with.
 //
+// Nothing the search does for a node allocates memory: the positions live
+// in the masks passed down the call stack, and everything else that
+// depends on the ply (the principal variations, the killer moves) is in
+// fixed arrays indexed by it. Only a search as a whole allocates: the
+// transposition table the first time, the helpers and their threads when
+// it uses several, and for every iteration its value in
+// m_iteration_values and the debug output. kreversi-allocations checks
+// that this stays so.
+
 // The class MoveAndValue is used by Engine to store all possible moves
 // at the first level and the values that were calculated for them.
 // This makes it possible to select a random move among those with equal
@@ -126,14 +172,20 @@
 //#include "Score.h"
 
 //#include <sys/times.h>
-#include <QVector>
+#include <QList>
+#include <QElapsedTimer>
 #include <krandomsequence.h>
 #include <string>
 #include "commondefs.h"
+#include "Bitboard.h"
+#include "TranspositionTable.h"
+#include "EndgameSolver.h"
+#include "MoveOrdering.h"
+#include "PatternEval.h"
+#include "OpeningBook.h"
+#include "ProbCut.h"
 #include "ai.h"
 
-class KReversiGame;
-
 static inline ChipColor opponentColorFor(ChipColor color)
 {
     if(color == NoColor)
@@ -143,56 +195,49 @@ static inline ChipColor opponentColorFor(ChipColor color)
 }
 
 
-// SquareStackEntry and SquareStack are used during search to keep
-// track of turned pieces.
+// Connect a move with its value.
 
-class SquareStackEntry
+class MoveAndValue
 {
 public:
-  SquareStackEntry();
+  MoveAndValue();
+  MoveAndValue(int x, int y, int value);
 
-  void setXY(int x, int y);
+  void  setXYV(int x, int y, int value);
 
 public:
   int  m_x;
   int  m_y;
+  int  m_value;
 };
 
+// ================================================================
+//                       class Score
 
-class SquareStack
-{
+/* This class keeps track of the score for both colors.  Such a score
+ * could be either the number of pieces, the score from the evaluation
+ * function or anything similar.
+ */
+class Score {
 public:
-  SquareStack();
-  SquareStack(int size);
-
-  void              resize(int size);
-  void              init(int size);
-  SquareStackEntry  Pop();
-  void              Push(int x, int y);
-
-private:
-  QVector<SquareStackEntry>  m_squarestack;
-  int                          m_top;
-};
-
+  Score()
+  {
+      m_score[White] = 0;
+      m_score[Black] = 0;
+  }
 
-// Connect a move with its value.
+  uint score(ChipColor color) const     { return m_score[color]; }
 
-class MoveAndValue
-{
-public:
-  MoveAndValue();
-  MoveAndValue(int x, int y, int value);
+  void set(ChipColor color, uint score) { m_score[color] = score; }
+  void inc(ChipColor color)             { m_score[color]++; }
+  void dec(ChipColor color)             { m_score[color]--; }
+  void add(ChipColor color, uint s)     { m_score[color] += s; }
+  void sub(ChipColor color, uint s)     { m_score[color] -= s; }
 
-  void  setXYV(int x, int y, int value);
-
-public:
-  int  m_x;
-  int  m_y;
-  int  m_value;
+private:
+  uint  m_score[2];
 };
 
-class Score;
 
 // The real beef of this program: the engine that finds good moves for
 // the computer player.
@@ -207,13 +252,14 @@ public:
 public:
   Engine(int st, int sd);
   Engine(int st);
-  Engine(std::string game_state);
+  Engine(const std::string& game_state);
   Engine();
 
   ~Engine();
 
   //added
   std::string getGameStateString() const;
+  void setGameState(const std::string& game_state);
   bool isLegalMove(int row, int col) const;
   bool isLegalMove(ChipColor turn, int row, int col) const;
   int getNumberOfMoves();
@@ -225,60 +271,176 @@ public:
   static char chipColor2Char(ChipColor chip_color);
   int whoWin();
 
-  KReversiPos     computeMove(const KReversiGame& game, bool competitive);
+  KReversiPos     searchMove();
+  KReversiPos     bookMove();
+
+  // Search on the opponent's time, for the searchMove() that follows
+  // its reply.  Goes on until it is cancelled or has searched to the
+  // end of the game.
+  void            ponder();
+
   bool isThinking() const { return m_computingMove; }
 
-  void  setInterrupt(bool intr) { m_interrupt = intr; }
-  bool  interrupted() const     { return m_interrupt; }
+  // The principal variation of the last searchMove(): the moves it
+  // expects both sides to play, starting with its own move. A pass is
+  // given as a position of -1, -1 with the color of the side that passes.
+  PosList  principalVariation() const;
+
+  // The values of the iterations of the last searchMove() that did not
+  // search to the end of the game, for depth 1, 2 and so on.
+  // kreversi-probcut fits the ProbCut parameters to them.
+  QList<int>  iterationValues() const { return m_iteration_values; }
+
+  // The number of nodes the last searchMove() searched in this thread.
+  // kreversi-allocations compares them with the memory the search
+  // allocated.
+  quint64  nodesSearched() const { return m_nodes_searched; }
+
+  // A competitive game is one where we try our damnedest to make the
+  // best move.  The opposite is a casual game where the engine might
+  // make "a mistake".  The idea behind this is not to scare away
+  // newbies.
+  void  setCompetitive(bool competitive) { m_competitive = competitive; }
+
+  // Make the search stop as soon as *cancel is true; searchMove() then
+  // returns an invalid move.  The flag is set by another thread (see
+  // AiWorker).  The search never clears it, so a search that is
+  // cancelled before it has started stops right away.  0 means that the
+  // search cannot be cancelled.
+  void  setCancelFlag(const volatile bool* cancel) { m_cancel = cancel ? cancel : &m_interrupt; }
 
   void  setStrength(uint strength) { m_strength = strength; }
   uint  strength() const { return m_strength; }
+
+  // How selective the search is, from 0 (not at all) to
+  // MAX_SELECTIVITY.  The higher it is, the more nodes Multi-ProbCut cuts
+  // off, and the deeper the search gets in the same time, at a greater
+  // risk of missing the best move.  It has no effect unless ProbCut
+  // parameters are installed.
+  static const uint MAX_SELECTIVITY = 4;
+  void  setSelectivity(uint selectivity) { m_selectivity = qMin(selectivity, uint(MAX_SELECTIVITY)); }
+  uint  selectivity() const { return m_selectivity; }
+
+  // Time that searchMove() may use, in milliseconds. 0 means no limit;
+  // the search then goes as deep as the strength says.
+  void  setTimeBudget(int msecs) { m_time_budget = msecs; }
+  int   timeBudget() const { return m_time_budget; }
+
+  // Number of threads searchMove() searches with.
+  void  setThreads(int threads) { m_threads = qMax(threads, 1); }
+  int   threads() const { return m_threads; }
+
   int      EvaluatePosition(ChipColor color);
   int getNumberOfMovesWithPass();
 private:
-  KReversiPos     ComputeFirstMove(const KReversiGame& game);
-  int      ComputeMove2(int xplay, int yplay, ChipColor color, int level,
-  int      cutoffval,
-  quint64  colorbits, quint64 opponentbits);
+  friend class SearchThread;
+
+  KReversiPos     ComputeFirstMove();
+  void     SearchIterations();
+  int      SearchRoot(ChipColor color, quint64 colorbits, quint64 opponentbits,
+                      quint64 key, int first_square, int alpha, int beta,
+                      MoveAndValue* moves, int& number_of_moves,
+                      int& max_square);
+  int      SolveMove(int square, quint64 colorbits, quint64 opponentbits,
+                     int maxval);
+  int      ComputeMove2(int square, ChipColor color, int level,
+                        int alpha, int beta,
+                        quint64 colorbits, quint64 opponentbits, quint64 key);
+
+  int      TryAllMoves(ChipColor color, int level, int alpha, int beta,
+                       quint64 colorbits, quint64 opponentbits, quint64 key);
+  void     UpdatePV(int level, int square);
+  bool     ProbCutTest(ChipColor color, int level, int alpha, int beta,
+                       quint64 colorbits, quint64 opponentbits, quint64 key,
+                       int& value);
+
+  int      EvaluateBits(ChipColor color, quint64 colorbits,
+                        quint64 opponentbits);
 
-  int      TryAllMoves(ChipColor opponent, int level, int cutoffval,
-  quint64  opponentbits, quint64 colorbits);
-
-  static void     SetupBcBoard();
-  void     SetupBits();
-  int      CalcBcScore(ChipColor color);
   quint64  ComputeOccupiedBits(ChipColor color);
 
-  void yield();
+  // True if the search has to stop, either because it was cancelled or
+  // because its time is up.
+  bool stopped() const { return *m_cancel || m_time_up; }
 
   //added
   void nextTurn();
   void flipPiece(int row, int col);
 
 private:
+  // Longest principal variation kept: all moves of a game, and some
+  // passes.
+  static const int MAX_PV_LENGTH = 64;
 
-  static int dcol[];
-  static int drow[];
+  static const int dcol[8];
+  static const int drow[8];
 
   ChipColor        m_board[10][10];
-  static int    m_bc_board[9][9];
-  Score*        m_score;
-  Score*        m_bc_score;
-  SquareStack  m_squarestack;
+  static const int  m_bc_board[9][9];
+  Score         m_score;
 
   int          m_depth;
   int          m_coeff;
-  int          m_nodes_searched;
+  quint64      m_nodes_searched;
   bool         m_exhaustive;
   bool         m_competitive;
   ChipColor    m_turn; // only to be used when Engine object constructed with Engine(string) ctor
 
   uint             m_strength;
+  uint             m_selectivity;
   KRandomSequence  m_random;
-  bool             m_interrupt;
-
-  quint64      m_coord_bit[9][9];
-  quint64      m_neighbor_bits[9][9];
+  volatile bool    m_interrupt;     // set by the main engine to stop a helper
+  const volatile bool*  m_cancel;   // m_interrupt, or the flag of setCancelFlag()
+
+  int              m_time_budget;
+  int              m_hard_deadline;  // 0 while there is no move to fall back to
+  bool             m_time_up;
+
+  // ponder() is searching, or the transposition table holds its
+  // results, found with m_ponder_coeff.
+  bool             m_pondering;
+  bool             m_pondered;
+  int              m_ponder_coeff;
+  QElapsedTimer    m_timer;
+
+  // Position at the root of the search, set up by searchMove().
+  ChipColor    m_root_color;
+  quint64      m_root_colorbits;
+  quint64      m_root_opponentbits;
+  quint64      m_root_key;
+  int          m_root_pieces;
+  int          m_first_depth;
+  int          m_max_depth;
+
+  // Result of the deepest completed iteration.
+  MoveAndValue m_moves[60];
+  int          m_number_of_moves;
+  int          m_maxval;
+  int          m_max_square;
+  int          m_root_pv[MAX_PV_LENGTH];   // squares, -1 for a pass
+  int          m_root_pv_length;
+  QList<int>   m_iteration_values;
+
+  // The principal variations of the nodes being searched, by level.
+  int          m_pv[MAX_PV_LENGTH][MAX_PV_LENGTH];
+  int          m_pv_length[MAX_PV_LENGTH];
+
+  // The pattern evaluation, or 0 if there are no weights for it.
+  const PatternEval*   m_pattern_eval;
+  PatternFeatures      m_features;   // of the position the search is in
+
+  // The parameters of the selective search, or 0 if there are none.
+  const ProbCut*       m_probcut;
+  bool                 m_in_probcut;  // while searching the shallow depth
+
+  EndgameSolver        m_solver;
+  MoveOrdering         m_ordering;
+  TranspositionTable   m_own_tt;
+  TranspositionTable*  m_tt;       // m_own_tt, or the table of the main engine in a helper
+
+  int              m_threads;
+  int              m_helper_index; // 0 for the main engine
+  QList<Engine*>   m_helpers;
 
   bool m_computingMove;
 };
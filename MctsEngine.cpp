@@ -0,0 +1,481 @@
+#include "MctsEngine.h"
+#include "Bitboard.h"
+#include "Engine.h"
+#include "Playout.h"
+
+#include <QThread>
+#include <KDebug>
+#include <cmath>
+
+// Deepest path through the tree: 60 moves and a pass before each.
+static const int MAX_PATH = 128;
+
+
+// Runs the search of an MctsEngine in one of the other threads of a
+// parallel search.
+//
+
+class MctsThread : public QThread
+{
+public:
+  MctsThread(MctsEngine* engine, quint64 seed, int max_playouts)
+    : m_engine(engine), m_seed(seed), m_max_playouts(max_playouts) {}
+
+protected:
+  void run() { m_engine->Search(m_seed, m_max_playouts); }
+
+private:
+  MctsEngine*  m_engine;
+  quint64      m_seed;
+  int          m_max_playouts;
+};
+
+
+MctsEngine::MctsEngine()
+    : m_pool(0), m_spare(0), m_size(0), m_root_own(0), m_root_opp(0),
+      m_selection(UCT), m_exploration(1.4), m_max_playouts(0),
+      m_time_budget(0), m_threads(1), m_parallel(TreeParallel),
+      m_virtual_loss(0), m_cancel(0), m_playouts(0),
+      m_random(Q_UINT64_C(0x2545F4914F6CDD1D))
+{
+}
+
+
+MctsEngine::~MctsEngine()
+{
+  qDeleteAll(m_helpers);
+  delete [] m_pool;
+  delete [] m_spare;
+}
+
+
+KReversiPos MctsEngine::searchMove(const Position& position)
+{
+  ChipColor color = position.turn();
+  quint64   own   = position.bits(color);
+  quint64   opp   = position.bits(opponentColorFor(color));
+
+  int max_playouts = m_max_playouts;
+  if (max_playouts == 0 && m_time_budget == 0)
+    max_playouts = DEFAULT_PLAYOUTS;
+
+  SetupRoot(own, opp);
+  m_playouts = 0;
+  m_timer.start();
+
+  // With a shared tree, all threads search this engine and share the
+  // playout limit.  Otherwise each helper gets its share of the limit
+  // and searches a tree of its own.
+  int helpers = (m_parallel == RootParallel) ? m_threads - 1 : 0;
+  while (m_helpers.size() < helpers)
+    m_helpers.append(new MctsEngine);
+  while (m_helpers.size() > helpers)
+    delete m_helpers.takeLast();
+
+  int share = max_playouts;
+  if (m_parallel == RootParallel && max_playouts > 0)
+    share = (max_playouts + m_threads - 1) / m_threads;
+
+  m_virtual_loss = (m_parallel == TreeParallel && m_threads > 1)
+    ? VIRTUAL_LOSS : 0;
+
+  QList<MctsThread*> threads;
+  for (int i = 1; i < m_threads; i++) {
+    MctsEngine* engine = this;
+
+    if (m_parallel == RootParallel) {
+      engine = m_helpers[i - 1];
+      engine->m_selection    = m_selection;
+      engine->m_exploration  = m_exploration;
+      engine->m_time_budget  = m_time_budget;
+      engine->m_virtual_loss = 0;
+      engine->SetupRoot(own, opp);
+      engine->m_cancel       = m_cancel;
+      engine->m_playouts = 0;
+      engine->m_timer    = m_timer;
+    }
+
+    threads.append(new MctsThread(engine, nextRandom(m_random), share));
+    threads.last()->start();
+  }
+
+  Search(nextRandom(m_random), share);
+
+  for (int i = 0; i < threads.size(); i++) {
+    threads[i]->wait();
+    delete threads[i];
+  }
+
+  // Add up the visits of the root moves over all trees, and play the
+  // move that was searched the most.  It is the one the search trusts
+  // most, its average may be based on just a few playouts.
+  int visits[65] = { 0 };   // by square, the pass last
+  int playouts   = m_playouts;
+
+  QList<MctsEngine*> trees = m_helpers;
+  trees.prepend(this);
+  for (int t = 0; t < trees.size(); t++) {
+    const MctsNode& root = trees[t]->m_pool[0];
+    for (int i = 0; i < root.m_number_of_children; i++) {
+      const MctsNode& child = trees[t]->m_pool[root.m_first_child + i];
+      visits[child.m_move < 0 ? 64 : int(child.m_move)] += child.m_visits;
+    }
+    if (t > 0)
+      playouts += trees[t]->m_playouts;
+  }
+
+  int best = -1;
+  for (int square = 0; square < 65; square++)
+    if (visits[square] > 0 && (best < 0 || visits[square] > visits[best]))
+      best = square;
+
+  // Without any playouts, take the first move.
+  const MctsNode& root = m_pool[0];
+  if (best < 0 && root.m_number_of_children > 0) {
+    int move = m_pool[root.m_first_child].m_move;
+    best = move < 0 ? 64 : move;
+  }
+
+  kDebug() << "playouts : " << playouts << " tree size : " << int(m_size)
+	   << " threads : " << m_threads << " time : " << m_timer.elapsed();
+
+  if (best < 0 || best == 64 || cancelled())
+    return KReversiPos(NoColor, -1, -1);
+
+  return KReversiPos(color, best / 8, best % 8);
+}
+
+
+void MctsEngine::ponder(const Position& position)
+{
+  int max_playouts = m_max_playouts;
+  int time_budget  = m_time_budget;
+
+  m_max_playouts = PONDER_PLAYOUTS;
+  m_time_budget  = 0;
+  searchMove(position);
+  m_max_playouts = max_playouts;
+  m_time_budget  = time_budget;
+}
+
+
+// Make own/opp the root, keeping what is known about it from the last
+// search.
+//
+
+void MctsEngine::SetupRoot(quint64 own, quint64 opp)
+{
+  if (!m_pool) {
+    m_pool  = new MctsNode[POOL_SIZE];
+    m_spare = new MctsNode[POOL_SIZE];
+  }
+
+  if (m_size > 0 && FindRoot(own, opp))
+    kDebug() << "reusing" << int(m_size) << "nodes of the last search";
+  else
+    NewTree();
+  m_root_own = own;
+  m_root_opp = opp;
+
+  Expand(0, own, opp);
+}
+
+
+// The search loop, run by searchMove() and the MctsThreads.  Several of
+// them may run at the same time on the same engine.
+//
+
+void MctsEngine::Search(quint64 seed, int max_playouts)
+{
+  quint64  random = seed;
+  int      count  = 0;
+
+  while (!cancelled()) {
+    Iterate(random);
+
+    int playouts = m_playouts.fetchAndAddRelaxed(1) + 1;
+    if (max_playouts > 0 && playouts >= max_playouts)
+      break;
+    if ((++count & 255) == 0 && m_time_budget > 0
+	&& m_timer.elapsed() >= m_time_budget)
+      break;
+  }
+}
+
+
+// One iteration: selection, expansion, playout and backpropagation.
+//
+
+void MctsEngine::Iterate(quint64& random)
+{
+  int      path[MAX_PATH + 1];
+  int      length = 0;
+  int      node   = 0;
+  quint64  own    = m_root_own;
+  quint64  opp    = m_root_opp;
+
+  path[length++] = node;
+  if (m_virtual_loss)
+    m_pool[node].m_visits.fetchAndAddOrdered(m_virtual_loss);
+
+  // Go down the tree.  Each child is reached by a move of the side to
+  // move in its parent, so the masks are swapped at every step.
+  for (;;) {
+    MctsNode& current = m_pool[node];
+    int first_child = current.m_first_child;
+
+    // A leaf that has been visited before gets its children now.  The
+    // first visit is just a playout, so that nodes are only added where
+    // the search comes back.  A node that another thread is expanding
+    // is treated as a leaf too.
+    if (first_child == -2)
+      break;
+    if (first_child == -1
+	&& (current.m_visits <= m_virtual_loss || !Expand(node, own, opp)))
+      break;
+    if (current.m_number_of_children == 0)
+      break;
+
+    node = SelectChild(node);
+
+    int square = m_pool[node].m_move;
+    if (square >= 0) {
+      quint64 flipped = flippedBits(square, own, opp);
+      own |= flipped | squareBit(square);
+      opp &= ~flipped;
+    }
+    qSwap(own, opp);
+    path[length++] = node;
+    if (m_virtual_loss)
+      m_pool[node].m_visits.fetchAndAddOrdered(m_virtual_loss);
+  }
+
+  // Result for the side to move at the end of the path: 2 if it wins, 1
+  // for a draw and 0 if it loses.
+  int diff;
+  if (m_pool[node].m_first_child >= 0 && m_pool[node].m_number_of_children == 0)
+    diff = bitCount(own) - bitCount(opp);
+  else
+    diff = randomPlayout(own, opp, random);
+  int result = diff > 0 ? 2 : (diff == 0 ? 1 : 0);
+
+  // The node at the end of the path was reached by a move of the other
+  // side, so its score gets the opposite result, and so on upwards.  The
+  // virtual losses are replaced by the real visit.
+  for (int i = length - 1; i >= 0; i--) {
+    result = 2 - result;
+    m_pool[path[i]].m_visits.fetchAndAddOrdered(1 - m_virtual_loss);
+    m_pool[path[i]].m_score.fetchAndAddOrdered(result);
+  }
+}
+
+
+// Give node its children, one for every legal move of the side owning
+// own, or a single pass.  Returns false if the pool is full.
+//
+
+bool MctsEngine::Expand(int node, quint64 own, quint64 opp)
+{
+  MctsNode& parent = m_pool[node];
+
+  // Claim the node, unless another thread has done so already.
+  if (!parent.m_first_child.testAndSetOrdered(-1, -2))
+    return parent.m_first_child >= 0;
+
+  quint64  legal = legalMoveBits(own, opp);
+  int      count = bitCount(legal);
+  bool     pass  = false;
+
+  if (count == 0) {
+    // Either a pass, or the game is over.
+    if (legalMoveBits(opp, own) == 0) {
+      parent.m_number_of_children = 0;
+      parent.m_first_child.fetchAndStoreOrdered(0);
+      return true;
+    }
+    count = 1;
+    pass  = true;
+  }
+
+  int first = -1;
+  if (m_size + count <= POOL_SIZE)
+    first = m_size.fetchAndAddOrdered(count);
+  if (first < 0 || first + count > POOL_SIZE) {
+    parent.m_first_child.fetchAndStoreOrdered(-1);
+    return false;
+  }
+
+  // The prior of PUCT: corners are good, the squares next to them bad,
+  // like in Engine::m_bc_board.
+  float total = 0;
+  for (int i = 0; i < count; i++) {
+    MctsNode& child = m_pool[first + i];
+    quint64   bit   = 0;
+
+    if (!pass) {
+      bit   = legal & -legal;
+      legal &= legal - 1;
+    }
+
+    child.m_first_child        = -1;
+    child.m_move               = pass ? -1 : firstBit(bit);
+    child.m_number_of_children = 0;
+    child.m_visits             = 0;
+    child.m_score              = 0;
+    child.m_prior              = (bit & BB_CORNERS) ? 4.0f
+      : (bit & BB_X_SQUARES) ? 0.25f
+      : (bit & BB_BAD_SQUARES) ? 0.5f
+      : 1.0f;
+    total += child.m_prior;
+  }
+  for (int i = 0; i < count; i++)
+    m_pool[first + i].m_prior /= total;
+
+  // Publish the children only when they are ready.
+  parent.m_number_of_children = count;
+  parent.m_first_child.fetchAndStoreOrdered(first);
+
+  return true;
+}
+
+
+// Return the child of node with the best bound.  Children that have not
+// been visited come first.
+//
+
+int MctsEngine::SelectChild(int node) const
+{
+  const MctsNode& parent = m_pool[node];
+  double  log_visits  = std::log(double(qMax(int(parent.m_visits), 1)));
+  double  sqrt_visits = std::sqrt(double(parent.m_visits));
+  double  best_value  = -1.0;
+  int     best        = parent.m_first_child;
+
+  for (int i = 0; i < parent.m_number_of_children; i++) {
+    int              index = parent.m_first_child + i;
+    const MctsNode&  child = m_pool[index];
+    double           value;
+
+    if (m_selection == PUCT) {
+      double mean = child.m_visits > 0
+	? child.m_score / (2.0 * child.m_visits) : 0.5;
+      value = mean + m_exploration * child.m_prior * sqrt_visits
+	/ (1 + child.m_visits);
+    }
+    else {
+      if (child.m_visits == 0)
+	return index;
+      value = child.m_score / (2.0 * child.m_visits)
+	+ m_exploration * std::sqrt(log_visits / child.m_visits);
+    }
+
+    if (value > best_value) {
+      best_value = value;
+      best       = index;
+    }
+  }
+
+  return best;
+}
+
+
+// Look for the position own/opp in the first few plies below the root
+// of the last search, and make it the root if it is there.
+//
+
+bool MctsEngine::FindRoot(quint64 own, quint64 opp)
+{
+  // Breadth first through the tree, up to our move, the reply and a
+  // pass.
+  const int  MAX_PLIES = 3;
+  int        level_start = 0;
+  int        nodes[4096];
+  quint64    owns[4096];
+  quint64    opps[4096];
+  int        count = 0;
+
+  nodes[count] = 0;
+  owns[count]  = m_root_own;
+  opps[count]  = m_root_opp;
+  count++;
+
+  for (int ply = 0; ply <= MAX_PLIES; ply++) {
+    int level_end = count;
+
+    for (int i = level_start; i < level_end; i++) {
+      if (owns[i] == own && opps[i] == opp) {
+	KeepSubtree(nodes[i]);
+	return true;
+      }
+
+      const MctsNode& node = m_pool[nodes[i]];
+      if (node.m_first_child < 0 || ply == MAX_PLIES)
+	continue;
+
+      for (int c = 0; c < node.m_number_of_children && count < 4096; c++) {
+	int      child   = node.m_first_child + c;
+	int      square  = m_pool[child].m_move;
+	quint64  mover   = owns[i];
+	quint64  other   = opps[i];
+
+	if (square >= 0) {
+	  quint64 flipped = flippedBits(square, mover, other);
+	  mover |= flipped | squareBit(square);
+	  other &= ~flipped;
+	}
+
+	nodes[count] = child;
+	owns[count]  = other;
+	opps[count]  = mover;
+	count++;
+      }
+    }
+
+    level_start = level_end;
+  }
+
+  return false;
+}
+
+
+// Copy the subtree below node to m_spare, with node as the new root,
+// and swap the pools.
+//
+
+void MctsEngine::KeepSubtree(int node)
+{
+  int size = 1;
+
+  m_spare[0] = m_pool[node];
+
+  // Every node copied is visited once in this loop, in the order they
+  // are copied, so the children of each node stay together.
+  for (int i = 0; i < size; i++) {
+    MctsNode& copy = m_spare[i];
+    if (copy.m_first_child < 0 || copy.m_number_of_children == 0)
+      continue;
+
+    int first = copy.m_first_child;
+    copy.m_first_child = size;
+    for (int c = 0; c < copy.m_number_of_children; c++)
+      m_spare[size++] = m_pool[first + c];
+  }
+
+  qSwap(m_pool, m_spare);
+  m_size = size;
+}
+
+
+void MctsEngine::NewTree()
+{
+  MctsNode& root = m_pool[0];
+
+  root.m_first_child        = -1;
+  root.m_move               = -1;
+  root.m_number_of_children = 0;
+  root.m_visits             = 0;
+  root.m_score              = 0;
+  root.m_prior              = 1.0f;
+  m_size = 1;
+}
+
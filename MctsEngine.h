@@ -0,0 +1,138 @@
+#ifndef KREVERSI_MCTSENGINE_H
+#define KREVERSI_MCTSENGINE_H
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QList>
+#include "Position.h"
+
+// MctsEngine finds moves with Monte Carlo tree search, as an alternative
+// to the alpha-beta search of Engine.
+//
+// Every iteration walks down the tree from the root, picking the child
+// with the best upper confidence bound at each node (UCT), or with the
+// AlphaZero style PUCT formula, where a simple prior based on the board
+// control values of the squares steers the search. When it reaches a
+// leaf it adds the children of the leaf to the tree, plays the game to
+// the end with random moves (a playout, done on bitboards, see
+// Playout.h), and adds the result to all nodes on the way back up.
+// The move played is the most visited child of the root.
+//
+// The nodes live in a pool that is allocated once. The children of a
+// node are allocated together, so a node only needs the index of its
+// first child and their number. When a new search starts in a position
+// that is already in the tree (usually after our own move and the reply
+// of the opponent), the subtree below it is kept: it is copied to the
+// start of a second pool, the pools are swapped and the rest of the old
+// tree is simply forgotten.
+//
+// Several threads can search at the same time (see setThreads()). By
+// default they share one tree: visits and scores are atomic counters,
+// and a node is expanded by the first thread that claims it. A thread
+// on its way down counts a virtual loss for every node it passes, which
+// makes the other threads prefer different paths until its result is
+// in. Alternatively, every thread searches a tree of its own (root
+// parallel search), and the visits of the root moves are added up.
+
+class MctsNode
+{
+public:
+  QAtomicInt  m_first_child;  // -1 if not expanded yet, -2 while being expanded
+  QAtomicInt  m_visits;       // including the virtual losses of searches on their way
+  QAtomicInt  m_score;        // 2 for each win and 1 for each draw of the side that made m_move
+  float       m_prior;        // used by PUCT
+  qint8       m_move;         // square of the move leading here, -1 for a pass
+  quint8      m_number_of_children;  // 0 in an expanded node: the game is over
+};
+
+
+class MctsEngine
+{
+public:
+  enum Selection {
+    UCT,
+    PUCT
+  };
+
+  enum Parallel {
+    TreeParallel,      // all threads search one shared tree
+    RootParallel       // every thread searches a tree of its own
+  };
+
+  MctsEngine();
+  ~MctsEngine();
+
+  // Number of playouts per move (of all threads together), and time per
+  // move in milliseconds. The search stops at whichever limit comes
+  // first; 0 means no limit. Without any limit, DEFAULT_PLAYOUTS
+  // playouts are made.
+  void  setPlayouts(int playouts)   { m_max_playouts = playouts; }
+  void  setTimeBudget(int msecs)    { m_time_budget = msecs; }
+
+  void  setSelection(Selection selection) { m_selection = selection; }
+  void  setExploration(double c)    { m_exploration = c; }
+
+  void  setThreads(int threads)     { m_threads = qMax(threads, 1); }
+  void  setParallel(Parallel parallel) { m_parallel = parallel; }
+
+  // Make the search stop as soon as *cancel is true, like
+  // Engine::setCancelFlag(); searchMove() then returns an invalid move.
+  void  setCancelFlag(const volatile bool* cancel) { m_cancel = cancel; }
+
+  // Search position and return the move for the side to move in it, with
+  // row and col from 0 to 7, or an invalid KReversiPos if it has to pass.
+  KReversiPos  searchMove(const Position& position);
+
+  // Search position on the time of the side to move in it, until the
+  // search is cancelled. The tree is kept for the searchMove() that
+  // follows its reply, like the tree of an earlier move.
+  void  ponder(const Position& position);
+
+  // Playouts made by the last search, and the nodes in the tree.
+  int   playouts() const  { return m_playouts; }
+  int   treeSize() const  { return m_size; }
+
+private:
+  friend class MctsThread;
+
+  bool     cancelled() const { return m_cancel && *m_cancel; }
+  void     SetupRoot(quint64 own, quint64 opp);
+  void     Search(quint64 seed, int max_playouts);
+  void     Iterate(quint64& random);
+  bool     Expand(int node, quint64 own, quint64 opp);
+  int      SelectChild(int node) const;
+
+  bool     FindRoot(quint64 own, quint64 opp);
+  void     KeepSubtree(int node);
+  void     NewTree();
+
+  static const int POOL_SIZE        = 1 << 19;
+  static const int DEFAULT_PLAYOUTS = 50000;
+  static const int PONDER_PLAYOUTS  = 1 << 28;  // keeps the visits within an int
+  static const int VIRTUAL_LOSS     = 3;
+
+  MctsNode*      m_pool;
+  MctsNode*      m_spare;       // the second pool, see KeepSubtree()
+  QAtomicInt     m_size;        // nodes in use in m_pool; the root is node 0
+
+  // The position at the root, from the side to move.
+  quint64        m_root_own;
+  quint64        m_root_opp;
+
+  Selection      m_selection;
+  double         m_exploration;
+  int            m_max_playouts;
+  int            m_time_budget;
+
+  int            m_threads;
+  Parallel       m_parallel;
+  int            m_virtual_loss;  // VIRTUAL_LOSS when threads share the tree, else 0
+  QList<MctsEngine*>  m_helpers;  // the other trees of a root parallel search
+
+  const volatile bool*  m_cancel;
+  QElapsedTimer  m_timer;
+  QAtomicInt     m_playouts;
+  quint64        m_random;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#include "MoveOrdering.h"
+#include "Bitboard.h"
+
+// History scores are halved when one of them gets above this, so that
+// the scores below stay within an int.
+static const int HISTORY_LIMIT = 1 << 16;
+
+
+MoveOrdering::MoveOrdering()
+{
+  for (int level = 0; level < MAX_LEVEL; level++)
+    m_killers[level][0] = m_killers[level][1] = -1;
+
+  for (int square = 0; square < 64; square++)
+    m_history[White][square] = m_history[Black][square] = 0;
+}
+
+
+void MoveOrdering::newSearch()
+{
+  for (int level = 0; level < MAX_LEVEL; level++)
+    m_killers[level][0] = m_killers[level][1] = -1;
+
+  for (int square = 0; square < 64; square++) {
+    m_history[White][square] >>= 1;
+    m_history[Black][square] >>= 1;
+  }
+}
+
+
+int MoveOrdering::orderMoves(ChipColor color, int level, quint64 own,
+			     quint64 opp, int hint, bool mobility,
+			     int* squares) const
+{
+  quint64 legal = legalMoveBits(own, opp);
+  int     count = 0;
+
+  // The hint and the killers go first, in this order.
+  if (hint >= 0 && (legal & squareBit(hint))) {
+    squares[count++] = hint;
+    legal &= ~squareBit(hint);
+  }
+
+  if (level < MAX_LEVEL) {
+    for (int i = 0; i < 2; i++) {
+      int killer = m_killers[level][i];
+      if (killer >= 0 && (legal & squareBit(killer))) {
+	squares[count++] = killer;
+	legal &= ~squareBit(killer);
+      }
+    }
+  }
+
+  // Sort the other moves by their scores, which are made up of (from the
+  // most significant bits) the mobility left to the opponent, the history
+  // score and the priority of the square.
+  int first = count;
+  int scores[64];
+
+  for (; legal; legal &= legal - 1) {
+    int square = firstBit(legal);
+    int score  = (m_history[color][square] << 4)
+      + (BB_SQUARE_PRIORITIES - squarePriority(square));
+
+    if (mobility) {
+      quint64 flipped = flippedBits(square, own, opp);
+      int     replies = bitCount(legalMoveBits(opp & ~flipped,
+						 own | flipped | squareBit(square)));
+      score += (64 - replies) << 21;
+    }
+
+    int i = count++;
+    for (; i > first && scores[i - 1] < score; i--) {
+      squares[i] = squares[i - 1];
+      scores[i]  = scores[i - 1];
+    }
+    squares[i] = square;
+    scores[i]  = score;
+  }
+
+  return count;
+}
+
+
+void MoveOrdering::addCutoff(ChipColor color, int level, int square, int depth)
+{
+  if (level < MAX_LEVEL && m_killers[level][0] != square) {
+    m_killers[level][1] = m_killers[level][0];
+    m_killers[level][0] = square;
+  }
+
+  m_history[color][square] += depth * depth;
+  if (m_history[color][square] > HISTORY_LIMIT) {
+    for (int i = 0; i < 64; i++)
+      m_history[color][i] >>= 1;
+  }
+}
@@ -0,0 +1,63 @@
+#ifndef KREVERSI_MOVEORDERING_H
+#define KREVERSI_MOVEORDERING_H
+
+#include <QList>
+#include "commondefs.h"
+
+// MoveOrdering decides in which order Engine tries the moves of a
+// position. Alpha-beta search cuts off the remaining moves as soon as one
+// move is good enough, so the sooner the best move comes, the fewer nodes
+// are searched.
+//
+// The moves of a position are tried in this order:
+//
+//  - The best move an earlier search stored in the transposition table
+//    (the hint), if there is one.
+//
+//  - The killer moves of the level: the last two moves that caused a
+//    cutoff in another position at the same distance from the root. The
+//    positions at one level tend to be alike, so what refuted one of them
+//    often refutes the others too.
+//
+//  - The other moves, by their history score: every move that causes a
+//    cutoff adds the square of the remaining depth to the score of its
+//    square, so moves that refuted big subtrees anywhere in the search
+//    come first. Near the root, where a few extra move generations cost
+//    little compared to the subtrees, the moves that leave the opponent
+//    the fewest replies come first instead ("fastest first", as in
+//    EndgameSolver), and the history only breaks ties. Moves with equal
+//    scores are ordered by a fixed priority of their squares: corners
+//    first and the squares next to the corners last.
+//
+// Every Engine has its own MoveOrdering, so helper threads do not share
+// (or fight over) their killers and history.
+
+class MoveOrdering
+{
+public:
+  // Killers are kept for this many levels.
+  static const int MAX_LEVEL = 64;
+
+  MoveOrdering();
+
+  // Forget the killers of the last search, which were found for other
+  // levels, and age the history so that newer cutoffs count more.
+  void  newSearch();
+
+  // Put the legal moves of color in the position (own, opp) into squares
+  // in the order they should be tried, and return their number. hint is
+  // tried first if it is a legal move; -1 means none. With mobility, the
+  // moves are sorted by the mobility they leave the opponent.
+  int   orderMoves(ChipColor color, int level, quint64 own, quint64 opp,
+		   int hint, bool mobility, int* squares) const;
+
+  // Record that the move of color at square caused a cutoff at level,
+  // with depth plies left to search.
+  void  addCutoff(ChipColor color, int level, int square, int depth);
+
+private:
+  int   m_killers[MAX_LEVEL][2];   // -1 for an empty slot
+  int   m_history[2][64];          // indexed by ChipColor and square
+};
+
+#endif
@@ -0,0 +1,172 @@
+#include "OpeningBook.h"
+#include "Symmetry.h"
+#include "TranspositionTable.h"
+
+#include <QFile>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+
+static const char  BOOK_FILE_MAGIC[4]  = { 'K', 'R', 'B', 'K' };
+static const int   BOOK_FILE_VERSION   = 1;
+static const int   BOOK_FILE_HEADER    = 16;
+static const int   BOOK_ENTRY_SIZE     = 16;
+
+
+// ================================================================
+//                        class OpeningBook
+
+
+OpeningBook::OpeningBook()
+    : m_file(0), m_data(0), m_entries(0)
+{
+}
+
+
+OpeningBook::~OpeningBook()
+{
+  Unload();
+}
+
+
+void OpeningBook::Unload()
+{
+  // Deleting the file also unmaps it.
+  delete m_file;
+  m_file    = 0;
+  m_data    = 0;
+  m_entries = 0;
+  m_copy.clear();
+}
+
+
+bool OpeningBook::load(const QString& fileName)
+{
+  Unload();
+
+  QFile* file = new QFile(fileName);
+  if (!file->open(QIODevice::ReadOnly) || file->size() < BOOK_FILE_HEADER) {
+    delete file;
+    return false;
+  }
+
+  qint64        size = file->size();
+  const uchar*  data = file->map(0, size);
+  if (data == 0) {
+    // Not every file system can map files. The entries are read with
+    // qFromLittleEndian() either way, so a copy does just as well.
+    m_copy = file->readAll();
+    data   = reinterpret_cast<const uchar*>(m_copy.constData());
+  }
+
+  qint64 entries = qFromLittleEndian<quint32>(data + 8);
+  if (memcmp(data, BOOK_FILE_MAGIC, 4) != 0
+      || qFromLittleEndian<quint32>(data + 4) != quint32(BOOK_FILE_VERSION)
+      || size != BOOK_FILE_HEADER + entries * BOOK_ENTRY_SIZE) {
+    delete file;
+    m_copy.clear();
+    return false;
+  }
+
+  if (m_copy.isEmpty())
+    m_file = file;
+  else
+    delete file;
+
+  m_data    = data + BOOK_FILE_HEADER;
+  m_entries = entries;
+
+  return true;
+}
+
+
+static bool entryLessThan(const BookEntry& entry1, const BookEntry& entry2)
+{
+  if (entry1.m_key != entry2.m_key)
+    return entry1.m_key < entry2.m_key;
+  return entry1.m_move.m_square < entry2.m_move.m_square;
+}
+
+
+bool OpeningBook::save(const QString& fileName, QVector<BookEntry> entries)
+{
+  QFile file(fileName);
+  if (!file.open(QIODevice::WriteOnly))
+    return false;
+
+  std::sort(entries.begin(), entries.end(), entryLessThan);
+
+  QByteArray data(BOOK_FILE_HEADER + entries.size() * BOOK_ENTRY_SIZE, 0);
+  uchar* out = reinterpret_cast<uchar*>(data.data());
+
+  memcpy(out, BOOK_FILE_MAGIC, 4);
+  qToLittleEndian<quint32>(BOOK_FILE_VERSION, out + 4);
+  qToLittleEndian<quint32>(entries.size(), out + 8);
+  out += BOOK_FILE_HEADER;
+
+  for (int i = 0; i < entries.size(); i++) {
+    const BookEntry& entry = entries[i];
+
+    qToLittleEndian<quint64>(entry.m_key, out);
+    qToLittleEndian<quint32>(entry.m_move.m_games, out + 8);
+    qToLittleEndian<quint16>(entry.m_move.m_win_rate, out + 12);
+    out[14] = entry.m_move.m_square;
+    out += BOOK_ENTRY_SIZE;
+  }
+
+  return file.write(data) == data.size();
+}
+
+
+QList<BookMove> OpeningBook::lookup(quint64 blackbits, quint64 whitebits,
+				    ChipColor color) const
+{
+  QList<BookMove> moves;
+  if (m_entries == 0)
+    return moves;
+
+  CanonicalForm canonical(blackbits, whitebits);
+  quint64 key = TranspositionTable::computeKey(canonical.blackBits(),
+					       canonical.whiteBits(), color);
+
+  // Find the first entry of the position.
+  int low  = 0;
+  int high = m_entries;
+  while (low < high) {
+    int middle = (low + high) / 2;
+    if (qFromLittleEndian<quint64>(m_data + middle * BOOK_ENTRY_SIZE) < key)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  for (int i = low; i < m_entries; i++) {
+    const uchar* entry = m_data + i * BOOK_ENTRY_SIZE;
+    if (qFromLittleEndian<quint64>(entry) != key)
+      break;
+
+    // In a symmetric position the move stands for several squares.
+    int squares[NUMBER_OF_SYMMETRIES];
+    int count = canonical.positionSquares(entry[14], squares);
+
+    for (int j = 0; j < count; j++) {
+      BookMove move;
+      move.m_square   = squares[j];
+      move.m_games    = qMax(int(qFromLittleEndian<quint32>(entry + 8)) / count, 1);
+      move.m_win_rate = qFromLittleEndian<quint16>(entry + 12);
+      moves.append(move);
+    }
+  }
+
+  return moves;
+}
+
+
+quint64 OpeningBook::canonicalKey(quint64 blackbits, quint64 whitebits,
+				  ChipColor color)
+{
+  CanonicalForm canonical(blackbits, whitebits);
+
+  return TranspositionTable::computeKey(canonical.blackBits(),
+					canonical.whiteBits(), color);
+}
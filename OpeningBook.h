@@ -0,0 +1,94 @@
+#ifndef KREVERSI_OPENINGBOOK_H
+#define KREVERSI_OPENINGBOOK_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QVector>
+#include "commondefs.h"
+
+class QFile;
+
+// OpeningBook holds moves for the first positions of the game together
+// with how they did in the games the book was built from, so that Engine
+// can play them without searching.
+//
+// The 8 symmetries of the board (rotations and mirror images) give
+// positions that are really the same, so the book stores every position
+// only once, in its canonical form (see Symmetry.h). A position is looked
+// up by the Zobrist key (see TranspositionTable.h) of its canonical form
+// and the side to move, and the squares of its moves are given in that
+// orientation as well.
+//
+// The book is read from a binary file that is mapped into memory, like
+// the pattern weights: a 16 byte header (the characters "KRBK", and the
+// format version, the number of entries and 0 as 32 bit integers),
+// followed by the entries sorted by key and square, all in little endian
+// byte order. An entry is 16 bytes: the key (64 bits), the number of
+// games the move was played in (32 bits), the points the side that made
+// the move got in those games in 1/10000 per game (16 bits; a win is
+// 10000, a draw 5000), the square (8 bits) and one unused byte. A
+// position has one entry for each of its moves, so they are found with
+// a binary search for the first one.
+//
+// Books are built by kreversi-bookbuilder from collections of games.
+
+// A move of the book.
+
+class BookMove
+{
+public:
+  int  m_square;
+  int  m_games;
+  int  m_win_rate;     // in 1/10000, see above
+};
+
+
+// An entry of a book file.
+
+class BookEntry
+{
+public:
+  quint64   m_key;
+  BookMove  m_move;    // m_square is in the canonical orientation
+};
+
+
+class OpeningBook
+{
+public:
+  OpeningBook();
+  ~OpeningBook();
+
+  // Map the book file. Returns false, and leaves the book empty, if the
+  // file cannot be opened or is not a valid book file.
+  bool  load(const QString& fileName);
+  bool  isLoaded() const { return m_data != 0; }
+  int   size() const     { return m_entries; }
+
+  // Write a book file with the given entries, in any order. Returns
+  // false if it cannot be written.
+  static bool  save(const QString& fileName, QVector<BookEntry> entries);
+
+  // The moves of the book for color in a position, with their squares in
+  // the orientation of the position. If the position is symmetric, a
+  // move of the book can stand for several squares that are all as good;
+  // each of them is returned with an equal share of the games.
+  QList<BookMove>  lookup(quint64 blackbits, quint64 whitebits,
+			  ChipColor color) const;
+
+  // The key of the canonical form of a position. The squares of its
+  // moves are given by CanonicalForm::canonicalSquare().
+  static quint64  canonicalKey(quint64 blackbits, quint64 whitebits,
+			       ChipColor color);
+
+private:
+  void  Unload();
+
+  QFile*         m_file;
+  QByteArray     m_copy;       // the entries, if the file cannot be mapped
+  const uchar*   m_data;       // the first entry
+  int            m_entries;
+};
+
+#endif
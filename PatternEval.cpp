@@ -0,0 +1,291 @@
+#include "PatternEval.h"
+#include "Bitboard.h"
+#include "Symmetry.h"
+
+#include <QFile>
+#include <QMutex>
+#include <QtEndian>
+#include <cstring>
+
+// The squares of a pattern in one orientation, and the symmetries (see
+// Symmetry.h) that give all of its instances.
+
+class PatternShape
+{
+public:
+  int  m_size;
+  int  m_squares[10];
+  int  m_instances;
+  int  m_symmetries[8];
+};
+
+static const PatternShape PATTERN_SHAPES[PatternEval::NUMBER_OF_PATTERNS] = {
+  // The first row and the X squares B2 and G2.
+  { 10, { 0, 1, 2, 3, 4, 5, 6, 7, 9, 14 },   4, { 0, 2, 4, 5 } },
+  { 9,  { 0, 1, 2, 8, 9, 10, 16, 17, 18 },   4, { 0, 1, 2, 3 } },
+  { 10, { 0, 1, 2, 3, 4, 8, 9, 10, 11, 12 }, 8, { 0, 1, 2, 3, 4, 5, 6, 7 } },
+  { 8,  { 0, 9, 18, 27, 36, 45, 54, 63 },    2, { 0, 1 } },
+  { 7,  { 1, 10, 19, 28, 37, 46, 55 },       4, { 0, 1, 2, 3 } },
+  { 6,  { 2, 11, 20, 29, 38, 47 },           4, { 0, 1, 2, 3 } },
+  { 5,  { 3, 12, 21, 30, 39 },               4, { 0, 1, 2, 3 } },
+  { 4,  { 4, 13, 22, 31 },                   4, { 0, 1, 2, 3 } }
+};
+
+// A square is part of at most this many features.
+static const int MAX_SQUARE_FEATURES = 8;
+
+static const char  WEIGHT_FILE_MAGIC[4]  = { 'K', 'R', 'P', 'W' };
+static const int   WEIGHT_FILE_VERSION   = 1;
+static const int   WEIGHT_FILE_HEADER    = 16;
+
+// For every square, the features it is part of and the power of 3 of its
+// digit in them.
+static int   s_square_features[64][MAX_SQUARE_FEATURES];
+static int   s_square_powers[64][MAX_SQUARE_FEATURES];
+static int   s_square_count[64];
+
+// For every feature, its pattern and the position of its table within a
+// stage.
+static PatternEval::Pattern  s_feature_pattern[PatternFeatures::NUMBER_OF_FEATURES];
+static int   s_feature_offset[PatternFeatures::NUMBER_OF_FEATURES];
+static bool  s_tables_ready = false;
+
+// The tables are set up by the first caller.  Engines may be constructed
+// and start searching in several threads at once, so this is guarded by
+// a mutex, like the loading of the weights in Engine.
+static QMutex  s_tables_mutex;
+
+
+static void setupTables()
+{
+  QMutexLocker locker(&s_tables_mutex);
+  if (s_tables_ready)
+    return;
+
+  for (int square = 0; square < 64; square++)
+    s_square_count[square] = 0;
+
+  int feature = 0;
+  int offset  = 2;     // after the mobility weights
+
+  for (int pattern = 0; pattern < PatternEval::NUMBER_OF_PATTERNS; pattern++) {
+    const PatternShape& shape = PATTERN_SHAPES[pattern];
+
+    for (int i = 0; i < shape.m_instances; i++) {
+      int power = 1;
+
+      for (int j = 0; j < shape.m_size; j++) {
+	int square = transformSquare(shape.m_squares[j], shape.m_symmetries[i]);
+	int n      = s_square_count[square]++;
+	Q_ASSERT(n < MAX_SQUARE_FEATURES);
+
+	s_square_features[square][n] = feature;
+	s_square_powers[square][n]   = power;
+	power *= 3;
+      }
+
+      s_feature_pattern[feature] = PatternEval::Pattern(pattern);
+      s_feature_offset[feature]  = offset;
+      feature++;
+    }
+
+    // The table of the pattern has an entry for every index.
+    int entries = 1;
+    for (int j = 0; j < shape.m_size; j++)
+      entries *= 3;
+    offset += entries;
+  }
+
+  s_tables_ready = true;
+}
+
+
+// ================================================================
+//                       class PatternFeatures
+
+
+void PatternFeatures::setup(quint64 blackbits, quint64 whitebits)
+{
+  setupTables();
+
+  for (int feature = 0; feature < NUMBER_OF_FEATURES; feature++)
+    m_index[feature] = 0;
+
+  for (quint64 bits = blackbits; bits; bits &= bits - 1)
+    Change(firstBit(bits), 1);
+  for (quint64 bits = whitebits; bits; bits &= bits - 1)
+    Change(firstBit(bits), 2);
+}
+
+
+// Add delta to the digit of square in all features that contain it.
+//
+
+inline void PatternFeatures::Change(int square, int delta)
+{
+  const int* features = s_square_features[square];
+  const int* powers   = s_square_powers[square];
+
+  for (int i = s_square_count[square] - 1; i >= 0; i--)
+    m_index[features[i]] += delta * powers[i];
+}
+
+
+void PatternFeatures::makeMove(ChipColor color, int square, quint64 flipped)
+{
+  // A turned piece goes from 2 to 1 if Black moves, and from 1 to 2 if
+  // White does.
+  int flip = color == Black ? -1 : 1;
+
+  Change(square, color == Black ? 1 : 2);
+  for (; flipped; flipped &= flipped - 1)
+    Change(firstBit(flipped), flip);
+}
+
+
+void PatternFeatures::unmakeMove(ChipColor color, int square, quint64 flipped)
+{
+  int flip = color == Black ? 1 : -1;
+
+  Change(square, color == Black ? -1 : -2);
+  for (; flipped; flipped &= flipped - 1)
+    Change(firstBit(flipped), flip);
+}
+
+
+// ================================================================
+//                       class PatternEval
+
+
+PatternEval::PatternEval()
+    : m_file(0), m_weights(0)
+{
+  setupTables();
+}
+
+
+PatternEval::~PatternEval()
+{
+  Unload();
+}
+
+
+void PatternEval::Unload()
+{
+  // Deleting the file also unmaps it.
+  delete m_file;
+  m_file    = 0;
+  m_weights = 0;
+  m_copy.clear();
+}
+
+
+bool PatternEval::load(const QString& fileName)
+{
+  Unload();
+
+  QFile* file = new QFile(fileName);
+  qint64 size = WEIGHT_FILE_HEADER
+    + qint64(NUMBER_OF_STAGES) * WEIGHTS_PER_STAGE * sizeof(qint16);
+
+  const uchar* data = 0;
+  if (file->open(QIODevice::ReadOnly) && file->size() == size)
+    data = file->map(0, size);
+
+  if (data == 0
+      || memcmp(data, WEIGHT_FILE_MAGIC, 4) != 0
+      || qFromLittleEndian<quint32>(data + 4) != quint32(WEIGHT_FILE_VERSION)
+      || qFromLittleEndian<quint32>(data + 8) != quint32(NUMBER_OF_STAGES)
+      || qFromLittleEndian<quint32>(data + 12) != quint32(WEIGHTS_PER_STAGE)) {
+    delete file;
+    return false;
+  }
+
+  m_file = file;
+
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+  m_weights = reinterpret_cast<const qint16*>(data + WEIGHT_FILE_HEADER);
+#else
+  // The weights are in the wrong byte order for this machine, so they
+  // have to be copied after all.
+  m_copy.resize(size - WEIGHT_FILE_HEADER);
+  qint16* weights = reinterpret_cast<qint16*>(m_copy.data());
+  for (int i = 0; i < NUMBER_OF_STAGES * WEIGHTS_PER_STAGE; i++)
+    weights[i] = qFromLittleEndian<qint16>(data + WEIGHT_FILE_HEADER + 2 * i);
+  m_weights = weights;
+
+  delete m_file;
+  m_file = 0;
+#endif
+
+  return true;
+}
+
+
+bool PatternEval::save(const QString& fileName, const qint16* weights)
+{
+  QFile file(fileName);
+  if (!file.open(QIODevice::WriteOnly))
+    return false;
+
+  uchar header[WEIGHT_FILE_HEADER];
+  memcpy(header, WEIGHT_FILE_MAGIC, 4);
+  qToLittleEndian<quint32>(WEIGHT_FILE_VERSION, header + 4);
+  qToLittleEndian<quint32>(NUMBER_OF_STAGES, header + 8);
+  qToLittleEndian<quint32>(WEIGHTS_PER_STAGE, header + 12);
+
+  QByteArray data(reinterpret_cast<const char*>(header), WEIGHT_FILE_HEADER);
+  data.resize(WEIGHT_FILE_HEADER
+	      + NUMBER_OF_STAGES * WEIGHTS_PER_STAGE * sizeof(qint16));
+
+  uchar* out = reinterpret_cast<uchar*>(data.data()) + WEIGHT_FILE_HEADER;
+  for (int i = 0; i < NUMBER_OF_STAGES * WEIGHTS_PER_STAGE; i++)
+    qToLittleEndian<qint16>(weights[i], out + 2 * i);
+
+  return file.write(data) == data.size();
+}
+
+
+int PatternEval::evaluate(const PatternFeatures& features,
+			  quint64 blackbits, quint64 whitebits) const
+{
+  const qint16* weights = m_weights
+    + stage(bitCount(blackbits | whitebits)) * WEIGHTS_PER_STAGE;
+
+  int value = 0;
+  for (int feature = 0; feature < PatternFeatures::NUMBER_OF_FEATURES; feature++)
+    value += weights[s_feature_offset[feature] + features.index(feature)];
+
+  quint64 empty = ~(blackbits | whitebits);
+
+  value += weights[MOBILITY_WEIGHT]
+    * (bitCount(legalMoveBits(blackbits, whitebits))
+       - bitCount(legalMoveBits(whitebits, blackbits)));
+  value += weights[POTENTIAL_MOBILITY_WEIGHT]
+    * (bitCount(adjacentBits(whitebits) & empty)
+       - bitCount(adjacentBits(blackbits) & empty));
+
+  return value;
+}
+
+
+int PatternEval::weightIndex(int feature, int index)
+{
+  setupTables();
+
+  return s_feature_offset[feature] + index;
+}
+
+
+int PatternEval::patternSize(Pattern pattern)
+{
+  return PATTERN_SHAPES[pattern].m_size;
+}
+
+
+PatternEval::Pattern PatternEval::featurePattern(int feature)
+{
+  setupTables();
+
+  return s_feature_pattern[feature];
+}
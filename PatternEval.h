@@ -0,0 +1,125 @@
+#ifndef KREVERSI_PATTERNEVAL_H
+#define KREVERSI_PATTERNEVAL_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include "commondefs.h"
+
+class QFile;
+
+// PatternEval evaluates positions with weights that are looked up for
+// patterns of squares, instead of the fixed board control values of
+// Engine.
+//
+// A pattern is a group of up to 10 squares: an edge together with its two
+// X squares, the 3x3 and the 2x5 squares in a corner, and the diagonals
+// of length 4 to 8. Every pattern occurs several times on the board, once
+// for each of its orientations (an instance, or feature). The contents of
+// an instance are read as a number in base 3, with a digit of 0 for an
+// empty square, 1 for a black and 2 for a white piece, and this number
+// is the index of its weight in the table of the pattern. All instances
+// of a pattern share the same table. The weights of the mobility (legal
+// moves) and the potential mobility (empty squares next to an opponent
+// piece) of both sides are added to the sum of the features.
+//
+// The game is split in NUMBER_OF_STAGES stages by the number of pieces on
+// the board, and every stage has weights of its own. The weights are in
+// hundredths of a piece, from the side of Black; White gets the negated
+// value.
+//
+// The weights are read from a binary file, which is mapped into memory
+// rather than read, so that it costs nothing to load: a 16 byte header
+// (the characters "KRPW", and the format version, the number of stages
+// and the number of weights per stage as 32 bit integers), followed by
+// the weights of each stage as 16 bit integers, all in little endian
+// byte order. Within a stage, the mobility and the potential mobility
+// weights come first, then the tables of the patterns in the order of
+// PatternEval::Pattern.
+//
+// The features of a position are kept in a PatternFeatures, which is
+// updated along with the moves made by the search, so that evaluating a
+// position only has to add up the weights.
+
+class PatternFeatures
+{
+public:
+  static const int NUMBER_OF_FEATURES = 34;
+
+  // Compute the features of a position from scratch.
+  void  setup(quint64 blackbits, quint64 whitebits);
+
+  // Update the features for a move of color at square that turns the
+  // pieces in flipped, and undo this again.
+  void  makeMove(ChipColor color, int square, quint64 flipped);
+  void  unmakeMove(ChipColor color, int square, quint64 flipped);
+
+  int   index(int feature) const { return m_index[feature]; }
+
+private:
+  void  Change(int square, int delta);
+
+  int   m_index[NUMBER_OF_FEATURES];
+};
+
+
+class PatternEval
+{
+public:
+  enum Pattern {
+    Edge2X,
+    Corner3x3,
+    Corner2x5,
+    Diagonal8,
+    Diagonal7,
+    Diagonal6,
+    Diagonal5,
+    Diagonal4,
+    NUMBER_OF_PATTERNS
+  };
+
+  static const int NUMBER_OF_STAGES  = 15;
+  static const int WEIGHTS_PER_STAGE = 147584;
+
+  // Positions of the scalar weights within a stage.
+  static const int MOBILITY_WEIGHT           = 0;
+  static const int POTENTIAL_MOBILITY_WEIGHT = 1;
+
+  PatternEval();
+  ~PatternEval();
+
+  // Map the weight file. Returns false, and leaves the evaluator empty,
+  // if the file cannot be opened or is not a valid weight file.
+  bool  load(const QString& fileName);
+  bool  isLoaded() const { return m_weights != 0; }
+
+  // Write a weight file with NUMBER_OF_STAGES * WEIGHTS_PER_STAGE
+  // weights, stage after stage. Returns false if it cannot be written.
+  static bool  save(const QString& fileName, const qint16* weights);
+
+  // Value of the position for Black, in hundredths of a piece. features
+  // must belong to the position.
+  int   evaluate(const PatternFeatures& features,
+		 quint64 blackbits, quint64 whitebits) const;
+
+  // The stage of a position with the given number of pieces.
+  static int  stage(int pieces)
+                { return (pieces - 4) * NUMBER_OF_STAGES / 61; }
+
+  // Position within a stage of the weight of a feature with the given
+  // index.
+  static int  weightIndex(int feature, int index);
+
+  // Number of squares in a pattern, and the pattern of a feature.
+  static int  patternSize(Pattern pattern);
+  static Pattern  featurePattern(int feature);
+
+private:
+  void  Unload();
+
+  QFile*         m_file;
+  QByteArray     m_copy;      // the weights, if they cannot be used in place
+  const qint16*  m_weights;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef KREVERSI_PLAYOUT_H
+#define KREVERSI_PLAYOUT_H
+
+#include "Bitboard.h"
+
+// Random playouts: games played to the end from a position with random
+// moves, which is how Monte Carlo searches value a position (see
+// MctsEngine, and Position::playouts() for the Lua AI). A playout only
+// needs the two masks of Bitboard.h and a random generator of a few bits
+// of state, so nothing is allocated and a thread can play hundreds of
+// thousands of them per second.
+
+// xorshift64*.  Every thread has a state of its own, which must not be
+// 0.
+static inline quint64 nextRandom(quint64& state)
+{
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * Q_UINT64_C(2685821657736338717);
+}
+
+// Pick one of the squares in legal, which must not be 0, at random.
+static inline int randomSquare(quint64 legal, quint64& random)
+{
+  for (int k = nextRandom(random) % bitCount(legal); k > 0; k--)
+    legal &= legal - 1;
+
+  return firstBit(legal);
+}
+
+// Play random moves from the position where own is to move until the
+// end of the game.  Returns the final difference in pieces, seen from
+// own.
+static inline int randomPlayout(quint64 own, quint64 opp, quint64& random)
+{
+  bool  passed  = false;
+  bool  swapped = false;
+
+  for (;;) {
+    quint64 legal = legalMoveBits(own, opp);
+
+    if (legal == 0) {
+      if (passed)
+	break;
+      passed = true;
+    }
+    else {
+      passed = false;
+
+      int square = randomSquare(legal, random);
+      quint64 flipped = flippedBits(square, own, opp);
+      own |= flipped | squareBit(square);
+      opp &= ~flipped;
+    }
+
+    qSwap(own, opp);
+    swapped = !swapped;
+  }
+
+  int diff = bitCount(own) - bitCount(opp);
+  return swapped ? -diff : diff;
+}
+
+#endif
@@ -0,0 +1,310 @@
+#include "Position.h"
+#include "Bitboard.h"
+#include "Playout.h"
+#include "Symmetry.h"
+#include "Engine.h"
+
+
+Position::Position()
+    : m_turn(Black), m_history_size(0)
+{
+  m_bits[White] = squareBit(27) | squareBit(36);
+  m_bits[Black] = squareBit(28) | squareBit(35);
+}
+
+
+Position::Position(const std::string& game_state)
+    : m_turn(Black), m_history_size(0)
+{
+  m_bits[White] = 0;
+  m_bits[Black] = 0;
+
+  for (int square = 0; square < 64 && square < int(game_state.size()); square++) {
+    ChipColor color = Engine::char2ChipColor(game_state[square]);
+    if (color != NoColor)
+      m_bits[color] |= squareBit(square);
+  }
+
+  // A position always has a side to move, since m_turn indexes m_bits.
+  // A missing or unknown turn is taken as Black's.
+  if (game_state.size() > 64
+      && Engine::char2ChipColor(game_state[64]) != NoColor)
+    m_turn = Engine::char2ChipColor(game_state[64]);
+}
+
+
+std::string Position::gameStateString() const
+{
+  std::string ret(65, Engine::NONE_REP);
+
+  for (int square = 0; square < 64; square++) {
+    if (m_bits[Black] & squareBit(square))
+      ret[square] = Engine::DARK_REP;
+    else if (m_bits[White] & squareBit(square))
+      ret[square] = Engine::LIGHT_REP;
+  }
+  ret[64] = Engine::chipColor2Char(m_turn);
+
+  return ret;
+}
+
+
+quint64 Position::legalMoves() const
+{
+  return legalMoveBits(m_bits[m_turn], m_bits[opponentColorFor(m_turn)]);
+}
+
+
+int Position::numberOfMoves() const
+{
+  return qMax(bitCount(legalMoves()), 1);
+}
+
+
+int Position::moveSquare(int index) const
+{
+  quint64 legal = legalMoves();
+
+  if (legal == 0)
+    return index == 0 ? -1 : -2;
+
+  for (; index > 0 && legal; index--)
+    legal &= legal - 1;
+
+  return legal ? firstBit(legal) : -2;
+}
+
+
+std::string Position::canonicalStateString() const
+{
+  CanonicalForm canonical(m_bits[Black], m_bits[White]);
+  Position      position;
+
+  position.m_bits[Black] = canonical.blackBits();
+  position.m_bits[White] = canonical.whiteBits();
+  position.m_turn        = m_turn;
+
+  return position.gameStateString();
+}
+
+
+int Position::canonicalMoveSquare(int index) const
+{
+  int square = moveSquare(index);
+  if (square < 0)
+    return square;
+
+  return CanonicalForm(m_bits[Black], m_bits[White]).canonicalSquare(square);
+}
+
+
+int Position::canonicalMoveIndex(int canonical_square) const
+{
+  quint64 legal = legalMoves();
+  if (legal == 0)
+    return canonical_square == -1 ? 0 : -1;
+  if (canonical_square < 0 || canonical_square > 63)
+    return -1;
+
+  CanonicalForm canonical(m_bits[Black], m_bits[White]);
+  int square = canonical.positionSquare(canonical_square);
+  if (!(legal & squareBit(square)))
+    return -1;
+
+  // The moves are ordered by square.
+  return bitCount(legal & (squareBit(square) - 1));
+}
+
+
+bool Position::makeMove(int index)
+{
+  int square = moveSquare(index);
+  if (square == -2 || m_history_size == MAX_HISTORY)
+    return false;
+
+  ChipColor     opponent = opponentColorFor(m_turn);
+  PositionMove& move     = m_history[m_history_size++];
+
+  move.m_square  = square;
+  move.m_flipped = 0;
+
+  if (square >= 0) {
+    move.m_flipped = flippedBits(square, m_bits[m_turn], m_bits[opponent]);
+    m_bits[m_turn]  |= move.m_flipped | squareBit(square);
+    m_bits[opponent] &= ~move.m_flipped;
+  }
+  m_turn = opponent;
+
+  return true;
+}
+
+
+bool Position::unmakeMove()
+{
+  if (m_history_size == 0)
+    return false;
+
+  const PositionMove& move = m_history[--m_history_size];
+  ChipColor           mover = opponentColorFor(m_turn);
+
+  if (move.m_square >= 0) {
+    m_bits[mover]  &= ~(move.m_flipped | squareBit(move.m_square));
+    m_bits[m_turn] |= move.m_flipped;
+  }
+  m_turn = mover;
+
+  return true;
+}
+
+
+bool Position::gameOver() const
+{
+  return legalMoveBits(m_bits[White], m_bits[Black]) == 0
+    && legalMoveBits(m_bits[Black], m_bits[White]) == 0;
+}
+
+
+ChipColor Position::leader() const
+{
+  int diff = bitCount(m_bits[Black]) - bitCount(m_bits[White]);
+
+  if (diff > 0)
+    return Black;
+  else if (diff < 0)
+    return White;
+  else
+    return NoColor;
+}
+
+
+// Position::evaluate() for the pieces of color in colorbits and those of
+// its opponent in opponentbits.
+static int evaluateBits(quint64 colorbits, quint64 opponentbits)
+{
+  int pieces = bitCount(colorbits | opponentbits);
+
+  // The depth and coefficient that Engine(std::string) computes for
+  // strength 1.
+  int depth = 1;
+  if (pieces + depth + 3 >= 64)
+    depth = 64 - pieces;
+  else if (pieces + depth + 4 >= 64)
+    depth += 2;
+  else if (pieces + depth + 5 >= 64)
+    depth++;
+
+  int  coeff      = 100 - (100 * (pieces + depth - 4)) / 60;
+  int  score_diff = bitCount(colorbits) - bitCount(opponentbits);
+
+  if (pieces + depth >= 64)
+    return score_diff;
+
+  return (100 - coeff) * score_diff
+    + coeff * positionalScoreBits(colorbits, opponentbits);
+}
+
+
+// Position::leafValue() in the same way.
+static int leafValueBits(quint64 colorbits, quint64 opponentbits)
+{
+  if (legalMoveBits(colorbits, opponentbits) == 0
+      && legalMoveBits(opponentbits, colorbits) == 0) {
+    int diff = bitCount(colorbits) - bitCount(opponentbits);
+    if (diff > 0)
+      return Position::WIN_VALUE;
+    else if (diff < 0)
+      return -Position::WIN_VALUE;
+  }
+
+  return evaluateBits(colorbits, opponentbits);
+}
+
+
+int Position::evaluate(ChipColor color) const
+{
+  return evaluateBits(m_bits[color], m_bits[opponentColorFor(color)]);
+}
+
+
+int Position::leafValue(ChipColor color) const
+{
+  return leafValueBits(m_bits[color], m_bits[opponentColorFor(color)]);
+}
+
+
+int Position::childLeafValues(ChipColor color, int* values) const
+{
+  ChipColor  opponent = opponentColorFor(m_turn);
+  quint64    own      = m_bits[m_turn];
+  quint64    opp      = m_bits[opponent];
+  quint64    legal    = legalMoveBits(own, opp);
+  bool       mover    = color == m_turn;
+
+  // A pass leaves the pieces as they are.
+  if (legal == 0) {
+    values[0] = mover ? leafValueBits(own, opp) : leafValueBits(opp, own);
+    return 1;
+  }
+
+  int count = 0;
+  for (; legal; legal &= legal - 1) {
+    int      square  = firstBit(legal);
+    quint64  flipped = flippedBits(square, own, opp);
+    quint64  own2    = own | flipped | squareBit(square);
+    quint64  opp2    = opp & ~flipped;
+
+    values[count++] = mover ? leafValueBits(own2, opp2) : leafValueBits(opp2, own2);
+  }
+
+  return count;
+}
+
+
+// Count a game that ended with a difference in pieces of diff.
+static void addResult(PlayoutResults& results, int diff)
+{
+  if (diff > 0)
+    results.m_wins++;
+  else if (diff < 0)
+    results.m_losses++;
+  else
+    results.m_draws++;
+}
+
+
+void Position::playouts(int count, ChipColor color, quint64& random,
+			PlayoutResults& total, PlayoutResults* moves) const
+{
+  ChipColor  opponent = opponentColorFor(m_turn);
+  quint64    own      = m_bits[m_turn];
+  quint64    opp      = m_bits[opponent];
+  quint64    legal    = legalMoveBits(own, opp);
+  int        number   = qMax(bitCount(legal), 1);
+  int        squares[MAX_MOVES];
+
+  // The squares of the moves by index, for moves.
+  int n = 0;
+  for (quint64 bits = legal; bits; bits &= bits - 1)
+    squares[n++] = firstBit(bits);
+
+  for (int i = 0; i < count; i++) {
+    int diff;
+
+    if (moves && legal != 0) {
+      int      square  = squares[i % number];
+      quint64  flipped = flippedBits(square, own, opp);
+
+      diff = -randomPlayout(opp & ~flipped, own | flipped | squareBit(square),
+			    random);
+    }
+    else
+      diff = randomPlayout(own, opp, random);
+
+    if (color != m_turn)
+      diff = -diff;
+
+    addResult(total, diff);
+    if (moves)
+      addResult(moves[i % number], diff);
+  }
+}
@@ -0,0 +1,127 @@
+#ifndef KREVERSI_POSITION_H
+#define KREVERSI_POSITION_H
+
+#include <QList>
+#include <string>
+#include "commondefs.h"
+
+// A position as seen by the Lua AI: the pieces of both colors as 64 bit
+// masks (see Bitboard.h) and the side to move.
+//
+// Moves are made and taken back in place. Every move made is pushed on a
+// small history, so unmakeMove() only has to restore the turned pieces
+// and the turn. This is what the game_state strings of the old aif
+// functions cost a whole Engine and a new string for.
+//
+// Moves are addressed by their index in the list of legal moves of the
+// side to move, ordered by row and then by column like
+// Engine::getAllMoves(). If there is no legal move, the only move is a
+// pass with index 0.
+
+class PositionMove
+{
+public:
+  int      m_square;    // row * 8 + col, or -1 for a pass
+  quint64  m_flipped;
+};
+
+
+// Results of random playouts (see Position::playouts()), as seen from
+// one of the sides.
+
+class PlayoutResults
+{
+public:
+  PlayoutResults() : m_wins(0), m_draws(0), m_losses(0) {}
+
+  int  games() const { return m_wins + m_draws + m_losses; }
+
+  int  m_wins;
+  int  m_draws;
+  int  m_losses;
+};
+
+
+class Position
+{
+public:
+  Position();
+
+  // The position given by game_state, in the format of
+  // Engine::getGameStateString().  If it has no side to move, Black is
+  // to move.
+  Position(const std::string& game_state);
+
+  // The position in the format of Engine::getGameStateString().
+  std::string  gameStateString() const;
+
+  ChipColor  turn() const { return m_turn; }
+  quint64    bits(ChipColor color) const { return m_bits[color]; }
+
+  quint64  legalMoves() const;
+
+  // Number of moves in the move list, a pass counted as one.
+  int   numberOfMoves() const;
+
+  // Square of the move with the given index, or -1 for a pass.
+  int   moveSquare(int index) const;
+
+  // The game_state of the canonical form of the position (see
+  // Symmetry.h), which it shares with all positions symmetric to it.
+  std::string  canonicalStateString() const;
+
+  // The square in the canonical form of the move with the given index,
+  // -1 for a pass and -2 if there is no such move. And the other way
+  // round, the index of the move at a square of the canonical form, or
+  // -1 if it is not a legal move.
+  int   canonicalMoveSquare(int index) const;
+  int   canonicalMoveIndex(int canonical_square) const;
+
+  // Make the move with the given index. Returns false if there is no such
+  // move or the history is full.
+  bool  makeMove(int index);
+  bool  unmakeMove();
+
+  // True if neither side can move any more.
+  bool       gameOver() const;
+
+  // The color with more pieces, or NoColor on a tie.
+  ChipColor  leader() const;
+
+  // Same value as Engine::EvaluatePosition() of an Engine set up from
+  // this position with strength 1.
+  int   evaluate(ChipColor color) const;
+
+  // The value of the position as a leaf of a search, seen from color:
+  // WIN_VALUE if the game is over and color has won, -WIN_VALUE if it
+  // has lost, and evaluate(color) otherwise.
+  static const int WIN_VALUE = 1 << 30;
+  int   leafValue(ChipColor color) const;
+
+  // The leafValue() of the position after each move, in values in the
+  // order of the move indexes, without making the moves. Returns the
+  // number of moves. values must have room for MAX_MOVES of them.
+  static const int MAX_MOVES = 64;
+  int   childLeafValues(ChipColor color, int* values) const;
+
+  // Play count games from the position to the end with random moves (see
+  // Playout.h), and add their results, seen from color, to total. If
+  // moves is not 0, the result of every game is also added to the entry
+  // of moves for the index of its first move; the first moves are then
+  // taken in turn, so that all of them are played about equally often.
+  // random is the state of the random generator, and must not be 0.
+  void  playouts(int count, ChipColor color, quint64& random,
+		 PlayoutResults& total, PlayoutResults* moves = 0) const;
+
+private:
+  // Enough for all moves of a game with a pass before each of them.
+  static const int MAX_HISTORY = 128;
+
+  quint64       m_bits[2];     // indexed by ChipColor
+  ChipColor     m_turn;
+
+  PositionMove  m_history[MAX_HISTORY];
+  int           m_history_size;
+};
+
+#endif
@@ -0,0 +1,114 @@
+#include "ProbCut.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QtEndian>
+#include <cmath>
+#include <cstring>
+
+static const char  PROBCUT_FILE_MAGIC[4]  = { 'K', 'R', 'P', 'C' };
+static const int   PROBCUT_FILE_VERSION   = 1;
+static const int   PROBCUT_FILE_HEADER    = 16;
+static const int   PROBCUT_PAIR_SIZE      = 16;
+
+// The slope is stored in fixed point with this many steps per unit.
+static const double SLOPE_UNIT = 65536.0;
+
+
+ProbCut::ProbCut()
+    : m_loaded(false)
+{
+  memset(m_number_of_pairs, 0, sizeof(m_number_of_pairs));
+}
+
+
+bool ProbCut::load(const QString& fileName)
+{
+  m_loaded = false;
+  memset(m_number_of_pairs, 0, sizeof(m_number_of_pairs));
+
+  // The file is small, so it is simply read rather than mapped.
+  QFile file(fileName);
+  if (!file.open(QIODevice::ReadOnly))
+    return false;
+
+  QByteArray   contents = file.readAll();
+  const uchar* data     = reinterpret_cast<const uchar*>(contents.constData());
+  if (contents.size() < PROBCUT_FILE_HEADER)
+    return false;
+
+  qint64 count = qFromLittleEndian<quint32>(data + 8);
+  if (memcmp(data, PROBCUT_FILE_MAGIC, 4) != 0
+      || qFromLittleEndian<quint32>(data + 4) != quint32(PROBCUT_FILE_VERSION)
+      || contents.size() != PROBCUT_FILE_HEADER + count * PROBCUT_PAIR_SIZE)
+    return false;
+
+  data += PROBCUT_FILE_HEADER;
+  for (int i = 0; i < count; i++, data += PROBCUT_PAIR_SIZE) {
+    ProbCutPair pair;
+    pair.m_stage         = data[0];
+    pair.m_depth         = data[1];
+    pair.m_shallow_depth = data[2];
+    pair.m_slope         = qFromLittleEndian<qint32>(data + 4) / SLOPE_UNIT;
+    pair.m_intercept     = qFromLittleEndian<qint32>(data + 8);
+    pair.m_sigma         = qFromLittleEndian<qint32>(data + 12);
+
+    // Leave out what the search cannot use: pairs out of range, and
+    // those whose shallow values say nothing about the deep ones.
+    if (pair.m_stage >= NUMBER_OF_STAGES
+	|| pair.m_depth < MIN_DEPTH || pair.m_depth > MAX_DEPTH
+	|| pair.m_shallow_depth < 1 || pair.m_shallow_depth >= pair.m_depth
+	|| pair.m_slope <= 0 || pair.m_sigma < 0)
+      continue;
+
+    int& number = m_number_of_pairs[pair.m_stage][pair.m_depth];
+    if (number < MAX_PAIRS)
+      m_pairs[pair.m_stage][pair.m_depth][number++] = pair;
+  }
+
+  m_loaded = true;
+  return true;
+}
+
+
+bool ProbCut::save(const QString& fileName, const QVector<ProbCutPair>& pairs)
+{
+  QFile file(fileName);
+  if (!file.open(QIODevice::WriteOnly))
+    return false;
+
+  QByteArray data(PROBCUT_FILE_HEADER + pairs.size() * PROBCUT_PAIR_SIZE, 0);
+  uchar* out = reinterpret_cast<uchar*>(data.data());
+
+  memcpy(out, PROBCUT_FILE_MAGIC, 4);
+  qToLittleEndian<quint32>(PROBCUT_FILE_VERSION, out + 4);
+  qToLittleEndian<quint32>(pairs.size(), out + 8);
+  out += PROBCUT_FILE_HEADER;
+
+  for (int i = 0; i < pairs.size(); i++) {
+    const ProbCutPair& pair = pairs[i];
+
+    out[0] = pair.m_stage;
+    out[1] = pair.m_depth;
+    out[2] = pair.m_shallow_depth;
+    qToLittleEndian<qint32>(qint32(floor(pair.m_slope * SLOPE_UNIT + 0.5)), out + 4);
+    qToLittleEndian<qint32>(qint32(floor(pair.m_intercept + 0.5)), out + 8);
+    qToLittleEndian<qint32>(qint32(ceil(pair.m_sigma)), out + 12);
+    out += PROBCUT_PAIR_SIZE;
+  }
+
+  return file.write(data) == data.size();
+}
+
+
+const ProbCutPair* ProbCut::pairs(int pieces, int depth, int& count) const
+{
+  count = 0;
+  if (depth < MIN_DEPTH || depth > MAX_DEPTH)
+    return 0;
+
+  int s = stage(qBound(4, pieces, 64));
+  count = m_number_of_pairs[s][depth];
+
+  return m_pairs[s][depth];
+}
@@ -0,0 +1,82 @@
+#ifndef KREVERSI_PROBCUT_H
+#define KREVERSI_PROBCUT_H
+
+#include <QString>
+#include <QVector>
+
+// ProbCut holds the parameters of Multi-ProbCut, the selective search of
+// Engine.
+//
+// The value of a search to some depth is quite well predicted by the
+// value of a much shallower search of the same position: the deep value
+// is about slope * shallow value + intercept, with an error that is
+// roughly normally distributed with standard deviation sigma. Before a
+// node is searched to depth d with a null window at beta, a search to
+// the shallow depth can then tell whether the deep value is very likely
+// to be at least beta (or at most alpha), and the node is cut off
+// without the deep search. How likely "very likely" is, is the
+// selectivity of the search: the predicted value has to clear the
+// window by a number of sigmas that Engine takes from its selectivity
+// level.
+//
+// Since the prediction depends on the depths and on how far the game
+// has gone, there is a pair of a deep and a shallow depth (with their
+// own slope, intercept and sigma) for every deep depth and stage of the
+// game, sometimes two with different shallow depths. They are tried in
+// turn, the cheaper one first.
+//
+// The parameters are fitted by kreversi-probcut to searches of positions
+// from real games, and read from a parameter file: a 16 byte header (the
+// characters "KRPC", and the format version, the number of pairs and 0
+// as 32 bit integers), followed by the pairs, all in little endian byte
+// order. A pair is 16 bytes: the stage, the deep and the shallow depth
+// and one unused byte, then the slope in 1/65536, the intercept and sigma
+// as 32 bit integers. The values are those of the evaluation the search
+// uses, so the parameters have to be fitted again whenever it changes.
+
+class ProbCutPair
+{
+public:
+  int     m_stage;
+  int     m_depth;
+  int     m_shallow_depth;
+  double  m_slope;
+  double  m_intercept;
+  double  m_sigma;
+};
+
+
+class ProbCut
+{
+public:
+  static const int NUMBER_OF_STAGES = 6;
+  static const int MIN_DEPTH        = 3;
+  static const int MAX_DEPTH        = 24;
+  static const int MAX_PAIRS        = 2;   // per stage and deep depth
+
+  ProbCut();
+
+  // Read the parameter file. Returns false, and leaves no pairs, if the
+  // file cannot be read or is not a valid parameter file.
+  bool  load(const QString& fileName);
+  bool  isLoaded() const { return m_loaded; }
+
+  // Write a parameter file with the given pairs. Returns false if it
+  // cannot be written.
+  static bool  save(const QString& fileName, const QVector<ProbCutPair>& pairs);
+
+  // The stage of a position with the given number of pieces.
+  static int  stage(int pieces) { return (pieces - 4) * NUMBER_OF_STAGES / 61; }
+
+  // The pairs for a search to depth in a position with the given number
+  // of pieces, in the order they should be tried, and their number in
+  // count.
+  const ProbCutPair*  pairs(int pieces, int depth, int& count) const;
+
+private:
+  bool         m_loaded;
+  ProbCutPair  m_pairs[NUMBER_OF_STAGES][MAX_DEPTH + 1][MAX_PAIRS];
+  int          m_number_of_pairs[NUMBER_OF_STAGES][MAX_DEPTH + 1];
+};
+
+#endif
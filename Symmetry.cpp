@@ -0,0 +1,148 @@
+#include "Symmetry.h"
+
+// SYMMETRY_SQUARES[symmetry][square] is transformSquare(square, symmetry).
+const qint8 SYMMETRY_SQUARES[NUMBER_OF_SYMMETRIES][64] = {
+  { // 0: none
+     0,  1,  2,  3,  4,  5,  6,  7,
+     8,  9, 10, 11, 12, 13, 14, 15,
+    16, 17, 18, 19, 20, 21, 22, 23,
+    24, 25, 26, 27, 28, 29, 30, 31,
+    32, 33, 34, 35, 36, 37, 38, 39,
+    40, 41, 42, 43, 44, 45, 46, 47,
+    48, 49, 50, 51, 52, 53, 54, 55,
+    56, 57, 58, 59, 60, 61, 62, 63
+  },
+  { // 1: columns mirrored
+     7,  6,  5,  4,  3,  2,  1,  0,
+    15, 14, 13, 12, 11, 10,  9,  8,
+    23, 22, 21, 20, 19, 18, 17, 16,
+    31, 30, 29, 28, 27, 26, 25, 24,
+    39, 38, 37, 36, 35, 34, 33, 32,
+    47, 46, 45, 44, 43, 42, 41, 40,
+    55, 54, 53, 52, 51, 50, 49, 48,
+    63, 62, 61, 60, 59, 58, 57, 56
+  },
+  { // 2: rows mirrored
+    56, 57, 58, 59, 60, 61, 62, 63,
+    48, 49, 50, 51, 52, 53, 54, 55,
+    40, 41, 42, 43, 44, 45, 46, 47,
+    32, 33, 34, 35, 36, 37, 38, 39,
+    24, 25, 26, 27, 28, 29, 30, 31,
+    16, 17, 18, 19, 20, 21, 22, 23,
+     8,  9, 10, 11, 12, 13, 14, 15,
+     0,  1,  2,  3,  4,  5,  6,  7
+  },
+  { // 3: half turn
+    63, 62, 61, 60, 59, 58, 57, 56,
+    55, 54, 53, 52, 51, 50, 49, 48,
+    47, 46, 45, 44, 43, 42, 41, 40,
+    39, 38, 37, 36, 35, 34, 33, 32,
+    31, 30, 29, 28, 27, 26, 25, 24,
+    23, 22, 21, 20, 19, 18, 17, 16,
+    15, 14, 13, 12, 11, 10,  9,  8,
+     7,  6,  5,  4,  3,  2,  1,  0
+  },
+  { // 4: transposed
+     0,  8, 16, 24, 32, 40, 48, 56,
+     1,  9, 17, 25, 33, 41, 49, 57,
+     2, 10, 18, 26, 34, 42, 50, 58,
+     3, 11, 19, 27, 35, 43, 51, 59,
+     4, 12, 20, 28, 36, 44, 52, 60,
+     5, 13, 21, 29, 37, 45, 53, 61,
+     6, 14, 22, 30, 38, 46, 54, 62,
+     7, 15, 23, 31, 39, 47, 55, 63
+  },
+  { // 5: quarter turn
+     7, 15, 23, 31, 39, 47, 55, 63,
+     6, 14, 22, 30, 38, 46, 54, 62,
+     5, 13, 21, 29, 37, 45, 53, 61,
+     4, 12, 20, 28, 36, 44, 52, 60,
+     3, 11, 19, 27, 35, 43, 51, 59,
+     2, 10, 18, 26, 34, 42, 50, 58,
+     1,  9, 17, 25, 33, 41, 49, 57,
+     0,  8, 16, 24, 32, 40, 48, 56
+  },
+  { // 6: quarter turn the other way
+    56, 48, 40, 32, 24, 16,  8,  0,
+    57, 49, 41, 33, 25, 17,  9,  1,
+    58, 50, 42, 34, 26, 18, 10,  2,
+    59, 51, 43, 35, 27, 19, 11,  3,
+    60, 52, 44, 36, 28, 20, 12,  4,
+    61, 53, 45, 37, 29, 21, 13,  5,
+    62, 54, 46, 38, 30, 22, 14,  6,
+    63, 55, 47, 39, 31, 23, 15,  7
+  },
+  { // 7: transposed and half turn
+    63, 55, 47, 39, 31, 23, 15,  7,
+    62, 54, 46, 38, 30, 22, 14,  6,
+    61, 53, 45, 37, 29, 21, 13,  5,
+    60, 52, 44, 36, 28, 20, 12,  4,
+    59, 51, 43, 35, 27, 19, 11,  3,
+    58, 50, 42, 34, 26, 18, 10,  2,
+    57, 49, 41, 33, 25, 17,  9,  1,
+    56, 48, 40, 32, 24, 16,  8,  0
+  }
+};
+
+
+// ================================================================
+//                        class CanonicalForm
+
+
+// Try all symmetries and keep the smallest masks. Ties are symmetries
+// of the position itself, and all of them are remembered.
+CanonicalForm::CanonicalForm(quint64 blackbits, quint64 whitebits)
+    : m_black(blackbits), m_white(whitebits), m_symmetries(1)
+{
+  for (int symmetry = 1; symmetry < NUMBER_OF_SYMMETRIES; symmetry++) {
+    quint64 black = transformBits(blackbits, symmetry);
+    quint64 white = transformBits(whitebits, symmetry);
+
+    if (black < m_black || (black == m_black && white < m_white)) {
+      m_black = black;
+      m_white = white;
+      m_symmetries = 0;
+    }
+    if (black == m_black && white == m_white)
+      m_symmetries |= 1 << symmetry;
+  }
+}
+
+
+// Of the squares a move can become in the canonical form, the smallest
+// is used, so that moves which are the same in a symmetric position get
+// the same canonical square.
+int CanonicalForm::canonicalSquare(int square) const
+{
+  int result = 64;
+  for (int symmetry = 0; symmetry < NUMBER_OF_SYMMETRIES; symmetry++)
+    if (m_symmetries & (1 << symmetry))
+      result = qMin(result, transformSquare(square, symmetry));
+
+  return result;
+}
+
+
+int CanonicalForm::positionSquare(int canonical_square) const
+{
+  return transformSquare(canonical_square, inverseSymmetry(symmetry()));
+}
+
+
+int CanonicalForm::positionSquares(int canonical_square, int* squares) const
+{
+  int count = 0;
+  for (int symmetry = 0; symmetry < NUMBER_OF_SYMMETRIES; symmetry++) {
+    if (!(m_symmetries & (1 << symmetry)))
+      continue;
+
+    int square = transformSquare(canonical_square, inverseSymmetry(symmetry));
+    int i = 0;
+    while (i < count && squares[i] != square)
+      i++;
+    if (i == count)
+      squares[count++] = square;
+  }
+
+  return count;
+}
@@ -0,0 +1,136 @@
+#ifndef KREVERSI_SYMMETRY_H
+#define KREVERSI_SYMMETRY_H
+
+#include <QtGlobal>
+
+// The board has 8 symmetries: the identity, the mirror images in the
+// middle row, the middle column and both diagonals, and the rotations by
+// a quarter, a half and three quarters of a turn. Positions that are
+// symmetric to each other have the same value, and their moves
+// correspond to each other square by square, so caches and books only
+// need to store one of them.
+//
+// A symmetry is numbered by what it does, in this order: bit 2 mirrors
+// the board in the A1-H8 diagonal (swaps rows and columns), then bit 0
+// mirrors the columns and bit 1 the rows. Squares and masks are laid out
+// as in Bitboard.h.
+//
+// The canonical form of a position (see CanonicalForm) is the one of its
+// 8 orientations with the smallest black mask, and of those the smallest
+// white mask. Keying a table by the canonical form makes all symmetric
+// positions share one entry; moves stored in the entry must then be
+// given as squares of the canonical form as well.
+
+static const int NUMBER_OF_SYMMETRIES = 8;
+
+// The square that each square goes to under each symmetry.
+extern const qint8 SYMMETRY_SQUARES[NUMBER_OF_SYMMETRIES][64];
+
+static inline int transformSquare(int square, int symmetry)
+{
+  return SYMMETRY_SQUARES[symmetry][square];
+}
+
+// The symmetry that undoes symmetry. The mirror images undo themselves,
+// but after a transposition the row and column mirrors trade places.
+static inline int inverseSymmetry(int symmetry)
+{
+  return symmetry == 5 || symmetry == 6 ? symmetry ^ 3 : symmetry;
+}
+
+// Mirror a mask in the A1-H8 diagonal.
+static inline quint64 transposeBits(quint64 bits)
+{
+  quint64 t;
+
+  t = Q_UINT64_C(0x0F0F0F0F00000000) & (bits ^ (bits << 28));
+  bits ^= t ^ (t >> 28);
+  t = Q_UINT64_C(0x3333000033330000) & (bits ^ (bits << 14));
+  bits ^= t ^ (t >> 14);
+  t = Q_UINT64_C(0x5500550055005500) & (bits ^ (bits << 7));
+  bits ^= t ^ (t >> 7);
+
+  return bits;
+}
+
+// Reverse the order of the columns of a mask.
+static inline quint64 mirrorColumns(quint64 bits)
+{
+  bits = ((bits >> 1) & Q_UINT64_C(0x5555555555555555))
+    | ((bits & Q_UINT64_C(0x5555555555555555)) << 1);
+  bits = ((bits >> 2) & Q_UINT64_C(0x3333333333333333))
+    | ((bits & Q_UINT64_C(0x3333333333333333)) << 2);
+  bits = ((bits >> 4) & Q_UINT64_C(0x0F0F0F0F0F0F0F0F))
+    | ((bits & Q_UINT64_C(0x0F0F0F0F0F0F0F0F)) << 4);
+
+  return bits;
+}
+
+// Reverse the order of the rows of a mask.
+static inline quint64 mirrorRows(quint64 bits)
+{
+  bits = ((bits >> 8) & Q_UINT64_C(0x00FF00FF00FF00FF))
+    | ((bits & Q_UINT64_C(0x00FF00FF00FF00FF)) << 8);
+  bits = ((bits >> 16) & Q_UINT64_C(0x0000FFFF0000FFFF))
+    | ((bits & Q_UINT64_C(0x0000FFFF0000FFFF)) << 16);
+
+  return (bits >> 32) | (bits << 32);
+}
+
+static inline quint64 transformBits(quint64 bits, int symmetry)
+{
+  if (symmetry & 4)
+    bits = transposeBits(bits);
+  if (symmetry & 1)
+    bits = mirrorColumns(bits);
+  if (symmetry & 2)
+    bits = mirrorRows(bits);
+
+  return bits;
+}
+
+
+// The canonical form of a position, and the symmetries that lead to it.
+// There is more than one if the position is symmetric itself.
+
+class CanonicalForm
+{
+public:
+  CanonicalForm(quint64 blackbits, quint64 whitebits);
+
+  quint64  blackBits() const  { return m_black; }
+  quint64  whiteBits() const  { return m_white; }
+
+  // A mask with bit s set for every symmetry s that gives the canonical
+  // form, and the first of them.
+  int   symmetries() const  { return m_symmetries; }
+  int   symmetry() const;
+
+  // The square in the canonical form of a square of the position. Squares
+  // that are the same because the position is symmetric get the same
+  // canonical square.
+  int   canonicalSquare(int square) const;
+
+  // A square of the position for a square of the canonical form, and all
+  // of them (at most 8, which are all equally good) in squares. The
+  // latter returns their number.
+  int   positionSquare(int canonical_square) const;
+  int   positionSquares(int canonical_square, int* squares) const;
+
+private:
+  quint64  m_black;
+  quint64  m_white;
+  int      m_symmetries;
+};
+
+
+inline int CanonicalForm::symmetry() const
+{
+  int symmetry = 0;
+  while (!(m_symmetries & (1 << symmetry)))
+    symmetry++;
+
+  return symmetry;
+}
+
+#endif
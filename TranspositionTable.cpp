@@ -0,0 +1,291 @@
+#include "TranspositionTable.h"
+#include "Bitboard.h"
+
+#include <cstring>
+
+
+TranspositionTable::TranspositionTable()
+    : m_memory(0), m_entries(0), m_bucketMask(0), m_generation(1)
+{
+}
+
+
+TranspositionTable::~TranspositionTable()
+{
+  delete [] m_memory;
+}
+
+
+// The Zobrist keys. They were drawn with xorshift64* from the fixed seed
+// 0x9E3779B97F4A7C15, in the order of the white square keys, the black
+// square keys, the side key and the exhaustive key, and are kept here as
+// constants so that no table has to set them up before it is used. The
+// opening book stores keys in its file, so they must not change.
+
+const quint64  TranspositionTable::s_squareKeys[2][64] = {
+  {
+    Q_UINT64_C(0x0D83B3E29A21487A), Q_UINT64_C(0x54C44C79F1FE9D67),
+    Q_UINT64_C(0xA845F342007A0E78), Q_UINT64_C(0x7D6E0B878A794779),
+    Q_UINT64_C(0x90D8D6E5A10DD485), Q_UINT64_C(0x9DE6CF0F6D5A586E),
+    Q_UINT64_C(0xD566404840A2AB9D), Q_UINT64_C(0x674BFECE098C4828),
+    Q_UINT64_C(0x87D6E3D2AFC200AC), Q_UINT64_C(0xD2F57AC518CBB99D),
+    Q_UINT64_C(0x002A74B4AEB82DB2), Q_UINT64_C(0xBC858F30D87296D1),
+    Q_UINT64_C(0x26D141D7B47A58A8), Q_UINT64_C(0xEC0202237FAA74FD),
+    Q_UINT64_C(0x13404CD3E565DFA1), Q_UINT64_C(0x54B07C175848B28D),
+    Q_UINT64_C(0x25072963263F0842), Q_UINT64_C(0x02ECC50074CCCF5F),
+    Q_UINT64_C(0xDACD1F060D908A3D), Q_UINT64_C(0x3C9AE8905BD77AE6),
+    Q_UINT64_C(0x9F7BC7DB18D2566C), Q_UINT64_C(0xAC76AEB5A047DBC6),
+    Q_UINT64_C(0xB71EB0AE33B29F39), Q_UINT64_C(0x3DF20C533DCC306C),
+    Q_UINT64_C(0xABCDBAA682DE9209), Q_UINT64_C(0x6786D31B243AC0A4),
+    Q_UINT64_C(0x849D9D80831E02D9), Q_UINT64_C(0xE2C9AB92EF636718),
+    Q_UINT64_C(0x0296F3277CFD51AC), Q_UINT64_C(0x0BE60E507909C1FD),
+    Q_UINT64_C(0x7956B9155FFD2ADB), Q_UINT64_C(0x88A5489881B0E754),
+    Q_UINT64_C(0xC99E7D7A6B1D3CCD), Q_UINT64_C(0x0DB292F12F361B02),
+    Q_UINT64_C(0xE7E8D30A316965CF), Q_UINT64_C(0x88048DB0941040FB),
+    Q_UINT64_C(0x1D1BBC9E745ED9C7), Q_UINT64_C(0x22717EEF126D3A5A),
+    Q_UINT64_C(0x834BC6881BE7BFC5), Q_UINT64_C(0x1301453FC472F3F7),
+    Q_UINT64_C(0x24A212ADF6CFEEE2), Q_UINT64_C(0xEEF2FC479582DAD0),
+    Q_UINT64_C(0x7BB62743D4A82368), Q_UINT64_C(0xE7B4EF83DC7C569A),
+    Q_UINT64_C(0x1C97D6C17A1CE09B), Q_UINT64_C(0xAEB34774571E0746),
+    Q_UINT64_C(0x8DACA89158B251F3), Q_UINT64_C(0xFAFF30D01D4B1980),
+    Q_UINT64_C(0xEC4798F19082AB12), Q_UINT64_C(0xE5215DB40AB9CE72),
+    Q_UINT64_C(0xC3E9CE5AEDCECE77), Q_UINT64_C(0x49D1DCFB32D131ED),
+    Q_UINT64_C(0x918E9E3E333146E3), Q_UINT64_C(0x50D51696787F55B4),
+    Q_UINT64_C(0xAA58A03BE88D5002), Q_UINT64_C(0xDA37A1FD3C69FEBC),
+    Q_UINT64_C(0x22FB986FBA1247F5), Q_UINT64_C(0x2CD822CEC6864769),
+    Q_UINT64_C(0x2F8B786E4EA0081E), Q_UINT64_C(0x993065D78EA4114D),
+    Q_UINT64_C(0x2B4BBEC88B15FC32), Q_UINT64_C(0xF5E013034672AD9E),
+    Q_UINT64_C(0x9C29A128FD9EF57C), Q_UINT64_C(0x1636F8E20698E92D)
+  },
+  {
+    Q_UINT64_C(0xF45A4999063C350F), Q_UINT64_C(0x16513F36F7CB2F45),
+    Q_UINT64_C(0x20CE772C97AD0958), Q_UINT64_C(0x8E8C2E8E1C50C30A),
+    Q_UINT64_C(0x8F90BC11DE2C3B28), Q_UINT64_C(0x1D9CD265CAF9AAAE),
+    Q_UINT64_C(0x85E846DD95161004), Q_UINT64_C(0xCBA1C108A6DE41C7),
+    Q_UINT64_C(0x1A5C7D55F70F690C), Q_UINT64_C(0xDF299A6336A13A58),
+    Q_UINT64_C(0xB51970AD741828D5), Q_UINT64_C(0x2150FF5E05151306),
+    Q_UINT64_C(0x8E9E171E8959989E), Q_UINT64_C(0xC1560FA6A2C6A718),
+    Q_UINT64_C(0x401F06C6C16C1346), Q_UINT64_C(0x22CB9BE13E9F2B4B),
+    Q_UINT64_C(0xDB6E9ABF1BD51537), Q_UINT64_C(0x59CE4401BED86164),
+    Q_UINT64_C(0x23A0BD555B58C420), Q_UINT64_C(0xFD6402DDE56B1FD6),
+    Q_UINT64_C(0xF03B990BF89BD645), Q_UINT64_C(0x607E3CD84C201DE6),
+    Q_UINT64_C(0x4EF15DE9FF656DA2), Q_UINT64_C(0xD527A619652F472F),
+    Q_UINT64_C(0x22FF9CD34B252992), Q_UINT64_C(0x0F7A4199AB0018F9),
+    Q_UINT64_C(0x789C99B9B7104BFC), Q_UINT64_C(0x047E5413EF331597),
+    Q_UINT64_C(0x31E064E2BA08761B), Q_UINT64_C(0xF2A4CDF6B08CCFAC),
+    Q_UINT64_C(0xF9BB2C6AA3B74B51), Q_UINT64_C(0x6E649BE9309A7AAD),
+    Q_UINT64_C(0x788BA774A28D717D), Q_UINT64_C(0x3B786508B3474F50),
+    Q_UINT64_C(0x7A92ACA2442CC9AF), Q_UINT64_C(0x0F3D9DE53F6EF4B2),
+    Q_UINT64_C(0x2983CEB87BD3BFA0), Q_UINT64_C(0x81C12D1D5E35716D),
+    Q_UINT64_C(0xA9490F9724BE51EF), Q_UINT64_C(0x090C066CE32F7B0F),
+    Q_UINT64_C(0x6736980B063D46FC), Q_UINT64_C(0x22B6F7BA6874F40E),
+    Q_UINT64_C(0x13AEFBB6611D895E), Q_UINT64_C(0x8F253558E6843A7A),
+    Q_UINT64_C(0x51EBB86D8D0C734D), Q_UINT64_C(0x90180EDCFF467A55),
+    Q_UINT64_C(0x04427A2D1FAF915E), Q_UINT64_C(0xD4867309EEFBA770),
+    Q_UINT64_C(0x1AEA2E225B7214BC), Q_UINT64_C(0x2E50398765648C31),
+    Q_UINT64_C(0x76431F96F583C75B), Q_UINT64_C(0x280033594D19939E),
+    Q_UINT64_C(0x58190CE2C2414047), Q_UINT64_C(0x1327051BEB2689C5),
+    Q_UINT64_C(0xB3144734100136CD), Q_UINT64_C(0x4F7A4D14869444CE),
+    Q_UINT64_C(0xED9E20549B1B7B78), Q_UINT64_C(0xC5EE11EC791B3496),
+    Q_UINT64_C(0x9947308E5EEDFFEF), Q_UINT64_C(0x316C9690EE0C70D1),
+    Q_UINT64_C(0x7FEA0E38A55133A5), Q_UINT64_C(0xC0DC7FE4035C2A04),
+    Q_UINT64_C(0x24FC0C1BF156A11B), Q_UINT64_C(0xA572C6B5864BA0D0)
+  }
+};
+
+// squareKey(White, square) ^ squareKey(Black, square)
+const quint64  TranspositionTable::s_flipKeys[64] = {
+  Q_UINT64_C(0xF9D9FA7B9C1D7D75), Q_UINT64_C(0x4295734F0635B222),
+  Q_UINT64_C(0x888B846E97D70720), Q_UINT64_C(0xF3E2250996298473),
+  Q_UINT64_C(0x1F486AF47F21EFAD), Q_UINT64_C(0x807A1D6AA7A3F2C0),
+  Q_UINT64_C(0x508E0695D5B4BB99), Q_UINT64_C(0xACEA3FC6AF5209EF),
+  Q_UINT64_C(0x9D8A9E8758CD69A0), Q_UINT64_C(0x0DDCE0A62E6A83C5),
+  Q_UINT64_C(0xB5330419DAA00567), Q_UINT64_C(0x9DD5706EDD6785D7),
+  Q_UINT64_C(0xA84F56C93D23C036), Q_UINT64_C(0x2D540D85DD6CD3E5),
+  Q_UINT64_C(0x535F4A152409CCE7), Q_UINT64_C(0x767BE7F666D799C6),
+  Q_UINT64_C(0xFE69B3DC3DEA1D75), Q_UINT64_C(0x5B228101CA14AE3B),
+  Q_UINT64_C(0xF96DA25356C84E1D), Q_UINT64_C(0xC1FEEA4DBEBC6530),
+  Q_UINT64_C(0x6F405ED0E0498029), Q_UINT64_C(0xCC08926DEC67C620),
+  Q_UINT64_C(0xF9EFED47CCD7F29B), Q_UINT64_C(0xE8D5AA4A58E37743),
+  Q_UINT64_C(0x89322675C9FBBB9B), Q_UINT64_C(0x68FC92828F3AD85D),
+  Q_UINT64_C(0xFC010439340E4925), Q_UINT64_C(0xE6B7FF810050728F),
+  Q_UINT64_C(0x337697C5C6F527B7), Q_UINT64_C(0xF942C3A6C9850E51),
+  Q_UINT64_C(0x80ED957FFC4A618A), Q_UINT64_C(0xE6C1D371B12A9DF9),
+  Q_UINT64_C(0xB115DA0EC9904DB0), Q_UINT64_C(0x36CAF7F99C715452),
+  Q_UINT64_C(0x9D7A7FA87545AC60), Q_UINT64_C(0x87391055AB7EB449),
+  Q_UINT64_C(0x349872260F8D6667), Q_UINT64_C(0xA3B053F24C584B37),
+  Q_UINT64_C(0x2A02C91F3F59EE2A), Q_UINT64_C(0x1A0D4353275D88F8),
+  Q_UINT64_C(0x43948AA6F0F2A81E), Q_UINT64_C(0xCC440BFDFDF62EDE),
+  Q_UINT64_C(0x6818DCF5B5B5AA36), Q_UINT64_C(0x6891DADB3AF86CE0),
+  Q_UINT64_C(0x4D7C6EACF71093D6), Q_UINT64_C(0x3EAB49A8A8587D13),
+  Q_UINT64_C(0x89EED2BC471DC0AD), Q_UINT64_C(0x2E7943D9F3B0BEF0),
+  Q_UINT64_C(0xF6ADB6D3CBF0BFAE), Q_UINT64_C(0xCB7164336FDD4243),
+  Q_UINT64_C(0xB5AAD1CC184D092C), Q_UINT64_C(0x61D1EFA27FC8A273),
+  Q_UINT64_C(0xC99792DCF17006A4), Q_UINT64_C(0x43F2138D9359DC71),
+  Q_UINT64_C(0x194CE70FF88C66CF), Q_UINT64_C(0x954DECE9BAFDBA72),
+  Q_UINT64_C(0xCF65B83B21093C8D), Q_UINT64_C(0xE9363322BF9D73FF),
+  Q_UINT64_C(0xB6CC48E0104DF7F1), Q_UINT64_C(0xA85CF34760A8619C),
+  Q_UINT64_C(0x54A1B0F02E44CF97), Q_UINT64_C(0x353C6CE7452E879A),
+  Q_UINT64_C(0xB8D5AD330CC85467), Q_UINT64_C(0xB3443E5780D349FD)
+};
+
+const quint64  TranspositionTable::s_sideKey       = Q_UINT64_C(0x88DB05EBFDDC3595);
+const quint64  TranspositionTable::s_exhaustiveKey = Q_UINT64_C(0x0BC67A3122477386);
+
+
+void TranspositionTable::resize(int megabytes)
+{
+  delete [] m_memory;
+
+  // Round down to a power of two number of buckets.
+  quint64 buckets = 1;
+  while (buckets * 2 * BUCKET_SIZE * sizeof(TTSlot)
+	 <= quint64(megabytes) * 1024 * 1024)
+    buckets *= 2;
+
+  size_t size = buckets * BUCKET_SIZE * sizeof(TTSlot);
+
+  // Over-allocate by one cache line so that the buckets can be aligned.
+  m_memory  = new char[size + 64];
+  m_entries = reinterpret_cast<TTSlot*>((reinterpret_cast<quintptr>(m_memory) + 63)
+					 & ~quintptr(63));
+  m_bucketMask = buckets - 1;
+
+  clear();
+}
+
+
+void TranspositionTable::clear()
+{
+  if (m_entries)
+    memset(m_entries, 0, (m_bucketMask + 1) * BUCKET_SIZE * sizeof(TTSlot));
+  m_generation = 1;
+}
+
+
+void TranspositionTable::newSearch()
+{
+  // Generation 0 is what a cleared entry has, so never use it.
+  if (++m_generation == 0)
+    clear();
+}
+
+
+bool TranspositionTable::probe(quint64 key, TTEntry& entry) const
+{
+  if (!m_entries)
+    return false;
+
+  const TTSlot* bucket = m_entries + (key & m_bucketMask) * BUCKET_SIZE;
+  for (int i = 0; i < BUCKET_SIZE; i++) {
+    // Read each half once, another thread may be writing the slot.
+    quint64 data = bucket[i].m_data;
+    quint64 lock = bucket[i].m_lock;
+
+    if ((lock ^ data) == key && data != 0) {
+      entry = unpack(data);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+void TranspositionTable::store(quint64 key, int value, int depth,
+			       Bound bound, int move)
+{
+  if (!m_entries)
+    return;
+
+  TTSlot*  bucket  = m_entries + (key & m_bucketMask) * BUCKET_SIZE;
+  TTSlot*  replace = bucket;
+  TTEntry  old;
+  bool     same    = false;
+  int      worst   = 1 << 30;
+
+  // Use the slot of the same position if there is one.  Otherwise
+  // replace the least valuable entry: entries from earlier searches go
+  // first, and among those of the same age the shallowest one.
+  for (int i = 0; i < BUCKET_SIZE; i++) {
+    quint64  data  = bucket[i].m_data;
+    TTEntry  entry = unpack(data);
+
+    if ((bucket[i].m_lock ^ data) == key && data != 0) {
+      replace = &bucket[i];
+      old     = entry;
+      same    = true;
+      break;
+    }
+
+    int worth = (data != 0 && isCurrent(entry) ? 256 : 0) + entry.m_depth;
+    if (worth < worst) {
+      worst   = worth;
+      replace = &bucket[i];
+    }
+  }
+
+  TTEntry entry;
+  entry.m_value      = value;
+  entry.m_depth      = depth;
+  entry.m_bound      = bound;
+  entry.m_move       = move;
+  entry.m_generation = m_generation;
+
+  if (same) {
+    // Keep a deeper result of this search, but remember the move.
+    if (isCurrent(old) && old.m_depth > depth) {
+      if (move < 0)
+	return;
+      entry = old;
+      entry.m_move = move;
+    }
+    // Do not lose a known best move when the new result has none.
+    else if (move < 0)
+      entry.m_move = old.m_move;
+  }
+
+  quint64 data = pack(entry);
+  replace->m_data = data;
+  replace->m_lock = key ^ data;
+}
+
+
+quint64 TranspositionTable::pack(const TTEntry& entry)
+{
+  return quint64(quint32(entry.m_value))
+    | quint64(entry.m_depth) << 32
+    | quint64(entry.m_bound) << 40
+    | quint64(quint8(entry.m_move)) << 48
+    | quint64(entry.m_generation) << 56;
+}
+
+
+TTEntry TranspositionTable::unpack(quint64 data)
+{
+  TTEntry entry;
+
+  entry.m_value      = qint32(quint32(data));
+  entry.m_depth      = quint8(data >> 32);
+  entry.m_bound      = quint8(data >> 40);
+  entry.m_move       = qint8(quint8(data >> 48));
+  entry.m_generation = quint8(data >> 56);
+
+  return entry;
+}
+
+
+quint64 TranspositionTable::computeKey(quint64 blackbits, quint64 whitebits,
+				       ChipColor turn)
+{
+  quint64 key = 0;
+
+  for (; blackbits; blackbits &= blackbits - 1)
+    key ^= s_squareKeys[Black][firstBit(blackbits)];
+  for (; whitebits; whitebits &= whitebits - 1)
+    key ^= s_squareKeys[White][firstBit(whitebits)];
+  if (turn == White)
+    key ^= s_sideKey;
+
+  return key;
+}
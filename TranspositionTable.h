@@ -0,0 +1,108 @@
+#ifndef KREVERSI_TRANSPOSITIONTABLE_H
+#define KREVERSI_TRANSPOSITIONTABLE_H
+
+#include <QList>
+#include "commondefs.h"
+
+// The transposition table remembers the result of searches in positions
+// that have already been visited, so that a position that is reached
+// through a different move order does not have to be searched again.
+//
+// Positions are identified by a 64 bit Zobrist key: the XOR of one random
+// number for every (color, square) pair that is occupied, and of one
+// more random number when White is to move. Placing or turning a piece
+// changes the key by a single XOR, so Engine updates it incrementally
+// while it makes moves (see squareKey() and flipKey()).
+//
+// The table is a fixed size array of buckets. A bucket holds 4 slots of
+// 16 bytes and is aligned to a 64 byte cache line, so a probe touches a
+// single line of memory.
+//
+// Several search threads may use the same table at the same time without
+// any locking. A slot stores the entry packed into 8 bytes of data, and
+// the key XOR'ed with that data. If two threads write the same slot at
+// the same time, the halves of the slot no longer match and the reader
+// just sees an unknown position.
+
+class TTEntry
+{
+public:
+  qint32   m_value;
+  quint8   m_depth;       // remaining depth of the search that stored it
+  quint8   m_bound;       // a TranspositionTable::Bound
+  qint8    m_move;        // best square, or -1 if not known
+  quint8   m_generation;  // search that stored it, see newSearch()
+};
+
+
+class TTSlot
+{
+public:
+  quint64  m_lock;        // the key XOR m_data
+  quint64  m_data;        // a packed TTEntry
+};
+
+
+class TranspositionTable
+{
+public:
+  // What the stored value says about the real value of the position.
+  enum Bound {
+    NoBound    = 0,
+    UpperBound = 1,      // the real value is at most m_value
+    LowerBound = 2,      // the real value is at least m_value
+    ExactBound = 3
+  };
+
+  TranspositionTable();
+  ~TranspositionTable();
+
+  // Allocate (and clear) room for 'megabytes' MB of entries. Until this
+  // is called, the table is empty and does not store anything.
+  void  resize(int megabytes);
+  bool  isAllocated() const { return m_entries != 0; }
+  void  clear();
+
+  // Start a new search. Values stored by earlier searches are not used
+  // any more since the evaluation may have changed in between, but
+  // their best moves are still good hints for move ordering.
+  void  newSearch();
+
+  // Look up key and copy what is stored into entry. Returns false if
+  // the position is not stored.
+  bool  probe(quint64 key, TTEntry& entry) const;
+  bool  isCurrent(const TTEntry& entry) const
+          { return entry.m_generation == m_generation; }
+
+  void  store(quint64 key, int value, int depth, Bound bound, int move);
+
+  // Zobrist keys.
+  static quint64  squareKey(ChipColor color, int square)
+                    { return s_squareKeys[color][square]; }
+  static quint64  flipKey(int square)   { return s_flipKeys[square]; }
+  static quint64  sideKey()             { return s_sideKey; }
+
+  // Mixed into the keys of exhaustive searches, whose values are final
+  // scores rather than evaluations and must not be confused with them.
+  static quint64  exhaustiveKey()       { return s_exhaustiveKey; }
+  static quint64  computeKey(quint64 blackbits, quint64 whitebits,
+			     ChipColor turn);
+
+private:
+  static quint64  pack(const TTEntry& entry);
+  static TTEntry  unpack(quint64 data);
+
+  static const int BUCKET_SIZE = 4;
+
+  char*     m_memory;
+  TTSlot*   m_entries;
+  quint64   m_bucketMask;
+  quint8    m_generation;
+
+  static const quint64  s_squareKeys[2][64];
+  static const quint64  s_flipKeys[64];
+  static const quint64  s_sideKey;
+  static const quint64  s_exhaustiveKey;
+};
+
+#endif
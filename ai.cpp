@@ -1,62 +1,271 @@
 #include <kdebug.h>
 #include <KStandardDirs>
+#include <QThread>
+#include <cmath>
 #include <iostream>
+#include <new>
 #include "ai.h"
+#include "Position.h"
 
 namespace aif{
 
+    // 1 if P1 (Black) won, -1 if P2 (White) won, 0 for a draw and 2 if
+    // the game is not over yet.
+    static int winnerCode(const Position& position) {
+        if(!position.gameOver())
+            return 2;
+        ChipColor leader = position.leader();
+        if(leader == Black)
+            return 1;
+        else if(leader == White)
+            return -1;
+        else
+            return 0;
+    }
+
     int getNumberOfMoves(lua_State *L) {
-        std::string game_state = luaL_checkstring(L, 1);
-        Engine engine(game_state);
-        lua_pushinteger(L, engine.getNumberOfMovesWithPass());
+        Position position(luaL_checkstring(L, 1));
+        lua_pushinteger(L, position.numberOfMoves());
         return 1;
     }
 
     int simulate(lua_State *L) {
-        std::string game_state = luaL_checkstring(L, 1);
+        Position position(luaL_checkstring(L, 1));
         int move_num = luaL_checkinteger(L, 2);
-        Engine engine(game_state);
-        PosList poslist = engine.getAllMoves();
-        engine.putPiece(poslist[move_num].row, poslist[move_num].col);
-        lua_pushstring(L, engine.getGameStateString().c_str());
+        if(!position.makeMove(move_num))
+            return luaL_error(L, "illegal move index %d", move_num);
+        lua_pushstring(L, position.gameStateString().c_str());
         return 1;
     }
 
     int whoWin(lua_State *L) {
-        std::string game_state = luaL_checkstring(L, 1);
-        Engine engine(game_state);
-        int winner = engine.whoWin();
-        int ret = 0;
-        if(winner == Engine::NONE_REP)
-            ret = 2;
-        else if (winner == Engine::DARK_REP)
-            ret = 1;
-        else if (winner == Engine::LIGHT_REP)
-            ret = -1;
-        else if (winner == Engine::TIE_REP)
-            ret = 0;
-        lua_pushinteger(L, ret);
+        Position position(luaL_checkstring(L, 1));
+        lua_pushinteger(L, winnerCode(position));
         return 1;
     }
 
     int getTurn(lua_State *L) {
-        std::string game_state = luaL_checkstring(L, 1);
-        Engine engine(game_state);
-        lua_pushinteger(L, Engine::chipColor2Char(engine.getTurn()));
+        Position position(luaL_checkstring(L, 1));
+        lua_pushinteger(L, Engine::chipColor2Char(position.turn()));
         return 1;
     }
 
     int evaluate(lua_State *L) {
-        std::string game_state = luaL_checkstring(L, 1);
-        Engine engine(game_state);
-        int ret = engine.EvaluatePosition(Black);//ai evaluate function is always seen from the first player perspective which is the black player
-        //kDebug() << "eval : " << ret << " ";
+        Position position(luaL_checkstring(L, 1));
+        int ret = position.evaluate(Black);//ai evaluate function is always seen from the first player perspective which is the black player
         lua_pushnumber(L, ret);
         return 1;
     }
+
+    // Position handles. The functions above parse the game_state string
+    // on every call and return a new one, these work on a Position kept in
+    // a userdata instead.
+
+    static const char* POSITION_METATABLE = "kreversi.Position";
+
+    static Position* checkPosition(lua_State *L, int index) {
+        return static_cast<Position*>(luaL_checkudata(L, index, POSITION_METATABLE));
+    }
+
+    static void pushPosition(lua_State *L, const Position& position) {
+        void* memory = lua_newuserdata(L, sizeof(Position));
+        new (memory) Position(position); // Position needs no destructor, so no __gc either
+        luaL_setmetatable(L, POSITION_METATABLE);
+    }
+
+    int newPosition(lua_State *L) {
+        if(lua_isnoneornil(L, 1))
+            pushPosition(L, Position());
+        else
+            pushPosition(L, Position(luaL_checkstring(L, 1)));
+        return 1;
+    }
+
+    int positionCopy(lua_State *L) {
+        pushPosition(L, *checkPosition(L, 1));
+        return 1;
+    }
+
+    int positionState(lua_State *L) {
+        lua_pushstring(L, checkPosition(L, 1)->gameStateString().c_str());
+        return 1;
+    }
+
+    // Keys for tables of positions: the state of the canonical form, the
+    // same for all positions that are symmetric to each other. Moves
+    // stored with such a key have to be stored as squares of the
+    // canonical form too (64 for a pass).
+    int positionKey(lua_State *L) {
+        lua_pushstring(L, checkPosition(L, 1)->canonicalStateString().c_str());
+        return 1;
+    }
+
+    int positionKeyMove(lua_State *L) {
+        int square = checkPosition(L, 1)->canonicalMoveSquare(luaL_checkinteger(L, 2));
+        if(square == -2)
+            return luaL_error(L, "illegal move index %d", (int)luaL_checkinteger(L, 2));
+        lua_pushinteger(L, square == -1 ? 64 : square);
+        return 1;
+    }
+
+    int positionMoveIndex(lua_State *L) {
+        int square = luaL_checkinteger(L, 2);
+        lua_pushinteger(L, checkPosition(L, 1)->canonicalMoveIndex(square == 64 ? -1 : square));
+        return 1;
+    }
+
+    int positionTurn(lua_State *L) {
+        lua_pushinteger(L, checkPosition(L, 1)->turn() == Black ? 1 : 2);
+        return 1;
+    }
+
+    int positionNumberOfMoves(lua_State *L) {
+        lua_pushinteger(L, checkPosition(L, 1)->numberOfMoves());
+        return 1;
+    }
+
+    int positionMove(lua_State *L) {
+        Position* position = checkPosition(L, 1);
+        int move_num = luaL_checkinteger(L, 2);
+        if(!position->makeMove(move_num))
+            return luaL_error(L, "illegal move index %d", move_num);
+        return 0;
+    }
+
+    int positionUndo(lua_State *L) {
+        if(!checkPosition(L, 1)->unmakeMove())
+            return luaL_error(L, "no move to undo");
+        return 0;
+    }
+
+    int positionWhoWin(lua_State *L) {
+        lua_pushinteger(L, winnerCode(*checkPosition(L, 1)));
+        return 1;
+    }
+
+    int positionEvaluate(lua_State *L) {
+        lua_pushnumber(L, checkPosition(L, 1)->evaluate(Black)); // seen from the first player, like evaluate()
+        return 1;
+    }
+
+    // The batch functions below fill the table given as their last
+    // argument, or a new one, so that a search can pass the same table
+    // for every node instead of creating one each time.
+    static int pushBuffer(lua_State *L, int index, int size) {
+        if(lua_isnoneornil(L, index)) {
+            lua_createtable(L, size, 0);
+        } else {
+            luaL_checktype(L, index, LUA_TTABLE);
+            lua_pushvalue(L, index);
+        }
+        return lua_gettop(L);
+    }
+
+    // Like the value miniMax gives a leaf: math.huge if P1 has won and
+    // -math.huge if P2 has, evaluate() otherwise.
+    static lua_Number leafNumber(int value) {
+        if(value == Position::WIN_VALUE)
+            return HUGE_VAL;
+        else if(value == -Position::WIN_VALUE)
+            return -HUGE_VAL;
+        return value;
+    }
+
+    int positionChildValues(lua_State *L) {
+        int values[Position::MAX_MOVES];
+        int count = checkPosition(L, 1)->childLeafValues(Black, values);
+        int buffer = pushBuffer(L, 2, count);
+        for(int i = 0; i < count; i++) {
+            lua_pushnumber(L, leafNumber(values[i]));
+            lua_rawseti(L, buffer, i + 1);
+        }
+        lua_pushinteger(L, count);
+        return 2;
+    }
+
+    // The state of the random generator of position:playouts(), one for
+    // every Lua state, in a userdata in the registry. Like math.random of
+    // ai.lua, it starts from the same seed every time, so that the games
+    // can be repeated.
+    static const char PLAYOUT_RANDOM_KEY = 0; // only its address is used
+    static const quint64 PLAYOUT_SEED = Q_UINT64_C(0x9E3779B97F4A7C15);
+
+    static void initPlayoutRandom(lua_State *L) {
+        quint64* random = static_cast<quint64*>(lua_newuserdata(L, sizeof(quint64)));
+        *random = PLAYOUT_SEED;
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &PLAYOUT_RANDOM_KEY);
+    }
+
+    static quint64& playoutRandom(lua_State *L) {
+        lua_rawgetp(L, LUA_REGISTRYINDEX, &PLAYOUT_RANDOM_KEY);
+        quint64* random = static_cast<quint64*>(lua_touserdata(L, -1));
+        lua_pop(L, 1);
+        return *random;
+    }
+
+    static void pushResults(lua_State *L, const PlayoutResults& results) {
+        lua_pushinteger(L, results.m_wins);
+        lua_pushinteger(L, results.m_draws);
+        lua_pushinteger(L, results.m_losses);
+    }
+
+    // The games are seen from the first player, like whoWin(). The
+    // whole call runs in C++, so it cannot be cancelled halfway.
+    int positionPlayouts(lua_State *L) {
+        Position* position = checkPosition(L, 1);
+        int count = luaL_checkinteger(L, 2);
+        bool by_move = lua_toboolean(L, 3);
+        PlayoutResults total;
+        PlayoutResults moves[Position::MAX_MOVES];
+
+        position->playouts(qMax(count, 0), Black, playoutRandom(L), total, by_move ? moves : 0);
+        pushResults(L, total);
+        if(!by_move)
+            return 3;
+
+        int number = position->numberOfMoves();
+        lua_createtable(L, number, 0);
+        for(int i = 0; i < number; i++) {
+            lua_createtable(L, 3, 0);
+            pushResults(L, moves[i]);
+            lua_rawseti(L, -4, 3);
+            lua_rawseti(L, -3, 2);
+            lua_rawseti(L, -2, 1);
+            lua_rawseti(L, -2, i + 1);
+        }
+        return 4;
+    }
+
+    int evaluateAll(lua_State *L) {
+        luaL_checktype(L, 1, LUA_TTABLE);
+        int count = lua_rawlen(L, 1);
+        int buffer = pushBuffer(L, 2, count);
+        for(int i = 1; i <= count; i++) {
+            lua_rawgeti(L, 1, i);
+            Position* position = static_cast<Position*>(luaL_testudata(L, -1, POSITION_METATABLE));
+            if(!position)
+                return luaL_error(L, "element %d is not a position", i);
+            lua_pop(L, 1);
+            lua_pushnumber(L, position->evaluate(Black));
+            lua_rawseti(L, buffer, i);
+        }
+        return 1;
+    }
 }
 
-lua_State* Ai::L = NULL;
+// Lua AIs cannot be stopped from outside, so while they search this hook
+// is called every CANCEL_HOOK_COUNT instructions to end the search with an
+// error once the move is cancelled. The flag is kept in the registry.
+static const int CANCEL_HOOK_COUNT = 10000;
+static const char CANCEL_FLAG_KEY = 0; // only its address is used
+
+static void cancelHook(lua_State *L, lua_Debug *) {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &CANCEL_FLAG_KEY);
+    const volatile bool* cancel = static_cast<const volatile bool*>(lua_touserdata(L, -1));
+    lua_pop(L, 1);
+    if(cancel && *cancel)
+        luaL_error(L, "move cancelled");
+}
 
 void bail(lua_State *L, const char *msg){
     kError() << "FATAL ERROR: " << msg << ": " << lua_tostring(L, -1);
@@ -69,36 +278,152 @@ static const struct luaL_Reg aiclib_funcs [] = {
     {"whoWin", aif::whoWin},
     {"getTurn", aif::getTurn},
     {"evaluate", aif::evaluate},
+    {"newPosition", aif::newPosition},
+    {"evaluateAll", aif::evaluateAll},
+    {NULL, NULL}  /* sentinel */
+};
+
+static const struct luaL_Reg position_methods [] = {
+    {"copy", aif::positionCopy},
+    {"state", aif::positionState},
+    {"key", aif::positionKey},
+    {"keyMove", aif::positionKeyMove},
+    {"moveIndex", aif::positionMoveIndex},
+    {"turn", aif::positionTurn},
+    {"numberOfMoves", aif::positionNumberOfMoves},
+    {"move", aif::positionMove},
+    {"undo", aif::positionUndo},
+    {"whoWin", aif::positionWhoWin},
+    {"evaluate", aif::positionEvaluate},
+    {"childValues", aif::positionChildValues},
+    {"playouts", aif::positionPlayouts},
     {NULL, NULL}  /* sentinel */
 };
 
 int luaopen_aiclib (lua_State *L) {
+    aif::initPlayoutRandom(L);
+
+    luaL_newmetatable(L, aif::POSITION_METATABLE);
+    luaL_newlib(L, position_methods);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+
     luaL_newlib(L, aiclib_funcs);
     return 1;
 }
 
 Ai::Ai(std::string ai_profile)
+    : L(NULL), profile_time_ms(0), profile_threads(1), profile_book(true), profile_selectivity(0), profile_ponder(false), mcts(NULL), cancel(NULL)
 {    
     QString ai_profiles_path = KStandardDirs::locate("appdata", "ai_profiles.lua");
 
-    staticInit();
+    initLua();
     lua_getglobal(L, "createProfile");
     lua_pushstring(L, ai_profiles_path.toAscii());
     lua_pushstring(L, ai_profile.c_str());
     if(lua_pcall(L, 2, 1, 0))
         bail(L, "lua_pcall() failed");          /* Error out if Lua file has an error */
 
+    lua_getfield(L, -1, "type");
+    if(lua_isstring(L, -1))
+        profile_type = lua_tostring(L, -1);
+    lua_pop(L, 1);
+
+    lua_getfield(L, -1, "time"); // in seconds, like the Lua algorithms use it
+    if(lua_isnumber(L, -1))
+        profile_time_ms = lua_tonumber(L, -1) * 1000;
+    lua_pop(L, 1);
+
+    lua_getfield(L, -1, "book"); // native profiles play from the opening book unless this is false
+    if(lua_isboolean(L, -1))
+        profile_book = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+
+    lua_getfield(L, -1, "threads");
+    if(lua_isnumber(L, -1))
+        profile_threads = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    if(profile_threads <= 0)
+        profile_threads = QThread::idealThreadCount();
+
+    lua_getfield(L, -1, "selectivity"); // 0 (full width) to Engine::MAX_SELECTIVITY
+    if(lua_isnumber(L, -1))
+        profile_selectivity = qMax(int(lua_tointeger(L, -1)), 0);
+    lua_pop(L, 1);
+
+    lua_getfield(L, -1, "ponder");
+    if(lua_isboolean(L, -1))
+        profile_ponder = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+
+    if(profile_type == "mcts") {
+        mcts = new MctsEngine;
+        mcts->setTimeBudget(profile_time_ms);
+        mcts->setThreads(profile_threads);
+
+        lua_getfield(L, -1, "playouts");
+        if(lua_isnumber(L, -1))
+            mcts->setPlayouts(lua_tointeger(L, -1));
+        lua_pop(L, 1);
+
+        lua_getfield(L, -1, "selection"); // "uct" or "puct"
+        if(lua_isstring(L, -1) && std::string(lua_tostring(L, -1)) == "puct")
+            mcts->setSelection(MctsEngine::PUCT);
+        lua_pop(L, 1);
+
+        lua_getfield(L, -1, "exploration");
+        if(lua_isnumber(L, -1))
+            mcts->setExploration(lua_tonumber(L, -1));
+        lua_pop(L, 1);
+
+        lua_getfield(L, -1, "parallel"); // "tree" or "root"
+        if(lua_isstring(L, -1) && std::string(lua_tostring(L, -1)) == "root")
+            mcts->setParallel(MctsEngine::RootParallel);
+        lua_pop(L, 1);
+    }
+
     profile_ref = luaL_ref(L, LUA_REGISTRYINDEX); // pop the resulting profile object and store its reference
 }
 
 Ai::~Ai()
 {
+    delete mcts;
     lua_close(L);
-    L = NULL;
 }
 
-KReversiPos Ai::selectMove(const Engine& engine)
+void Ai::setCancelFlag(const volatile bool* flag)
+{
+    cancel = flag;
+    if(mcts)
+        mcts->setCancelFlag(cancel);
+
+    lua_pushlightuserdata(L, const_cast<bool*>(cancel));
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &CANCEL_FLAG_KEY);
+    if(cancel)
+        lua_sethook(L, cancelHook, LUA_MASKCOUNT, CANCEL_HOOK_COUNT);
+    else
+        lua_sethook(L, NULL, 0, 0);
+}
+
+KReversiPos Ai::selectMove(Engine& engine)
 {
+    engine.setCancelFlag(cancel);
+
+    if(profile_book && (profile_type == "alphabeta" || profile_type == "mcts")) {
+        KReversiPos move = engine.bookMove();
+        if(move.isValid())
+            return move;
+    }
+
+    if(profile_type == "alphabeta") {
+        engine.setTimeBudget(profile_time_ms);
+        engine.setThreads(profile_threads);
+        engine.setSelectivity(profile_selectivity);
+        return engine.searchMove();
+    }
+    if(profile_type == "mcts")
+        return mcts->searchMove(Position(engine.getGameStateString()));
+
     PosList legalMoves = engine.getAllMoves();
 
     for(int i=0;i<legalMoves.size();i++)
@@ -108,8 +433,13 @@ KReversiPos Ai::selectMove(const Engine& engine)
     lua_rawgeti(L, LUA_REGISTRYINDEX, profile_ref);
     lua_pushstring(L, engine.getGameStateString().c_str());
 
-    if(lua_pcall(L, 2, 1, 0))
+    if(lua_pcall(L, 2, 1, 0)) {
+        if(cancel && *cancel) {
+            lua_pop(L, 1);  /* pop the error of cancelHook */
+            return KReversiPos();
+        }
         bail(L, "lua_pcall() failed");          /* Error out if Lua file has an error */
+    }
 
     int ret = lua_tonumber(L, -1);
     lua_pop(L, 1);  /* pop returned value */
@@ -120,9 +450,24 @@ KReversiPos Ai::selectMove(const Engine& engine)
     return legalMoves[ret];
 }
 
-void Ai::staticInit()
+void Ai::ponder(Engine& engine)
+{
+    if(!profile_ponder)
+        return;
+
+    engine.setCancelFlag(cancel);
+    if(profile_type == "alphabeta") {
+        engine.setThreads(profile_threads);
+        engine.setSelectivity(profile_selectivity);
+        engine.ponder();
+    }
+    else if(profile_type == "mcts")
+        mcts->ponder(Position(engine.getGameStateString()));
+}
+
+void Ai::initLua()
 {
-    if(L == NULL) {        
+    if(L == NULL) {
         QString ai_lib_path = KStandardDirs::locate("appdata", "ai.lua");
         L = luaL_newstate();
         luaL_openlibs(L);                           /* open all standard Lua libraries */
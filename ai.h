@@ -9,6 +9,7 @@
 #include <string>
 
 #include "Engine.h"
+#include "MctsEngine.h"
 
 class Engine;
 
@@ -17,11 +18,26 @@ class Ai
 public:
     Ai(std::string ai_profile);
     ~Ai();
-    KReversiPos selectMove(const Engine& engine);
-    static void staticInit();
+    KReversiPos selectMove(Engine& engine);
+    // Search the position of engine on the time of the side to move, for
+    // the selectMove() after its reply, if the profile ponders.
+    void ponder(Engine& engine);
+    // selectMove() returns an invalid move as soon as *cancel is true. It
+    // is set by another thread, see Engine::setCancelFlag().
+    void setCancelFlag(const volatile bool* cancel);
 private:
-    static lua_State *L;
+    void initLua();
+
+    lua_State *L; // every Ai has its own, so that Ais can be used from several threads
     int profile_ref;
+    std::string profile_type; // "alphabeta" is searched by Engine itself, everything else by ai.lua
+    int profile_time_ms; // time budget of native searches, 0 if the profile has none
+    int profile_threads; // threads of native searches, 0 means one per core
+    bool profile_book; // native searches play from the opening book first
+    int profile_selectivity; // selectivity of native alpha-beta searches, see Engine::setSelectivity()
+    bool profile_ponder; // native searches think on the opponent's time
+    MctsEngine* mcts; // searches "mcts" profiles, kept between moves to reuse the tree
+    const volatile bool* cancel; // 0 if moves are not cancelled
 };
 
 namespace aif {
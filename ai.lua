@@ -7,6 +7,25 @@
 	
 	for all algorithm with heuristic : 
 	double evaluate(game_state) : return heuristic value for given game_state, if the winner is P1, it should return Double.MAX_VALUE, and if the winner is P2, it should return Double.MIN_VALUE  
+	
+	the same on a position handle, which is changed in place instead of creating a new game_state for every move : 
+	position aif.newPosition(game_state) : return a new position handle
+	position position:copy() : return an independent copy of position
+	string position:state() : return the game_state of position
+	string position:key() : return the same string for position and for all positions that are rotated or mirrored versions of it, to be used as the key of tables of positions
+	int position:keyMove(move_index) : return move number move_index as it has to be stored along with position:key() (a square of the rotated or mirrored position the key stands for, 64 for a pass)
+	int position:moveIndex(key_move) : return the move index of a move stored along with position:key(), -1 if it is not legal
+	int position:turn() : return 1 for P1 and return 2 for P2
+	int position:numberOfMoves() : like aif.getNumberOfMoves
+	void position:move(move_index) : play move number move_index(zero-based index)
+	void position:undo() : take back the last move played with position:move
+	int position:whoWin() : like aif.whoWin
+	double position:evaluate() : like aif.evaluate
+	
+	the same for many positions in one call, to be used where a search would otherwise make a call for each of them. buffer is an optional table that is filled and returned instead of a new one : 
+	table, int position:childValues(buffer) : return the values of the positions after each move, at index move_index + 1, and the number of moves. A value is math.huge if P1 has won, math.huge * -1 if P2 has won, and like position:evaluate() otherwise
+	table aif.evaluateAll(positions, buffer) : return position:evaluate() of each position in the array positions, at the same index
+	int, int, int, table position:playouts(count, by_move) : play count random games from position to the end, in C++, and return how many P1 won, how many were a draw and how many P2 won. if by_move is true, the first moves are taken in turn and the same counts for each of them are returned too, as {p1_wins, draws, p2_wins} at index move_index + 1
 ]]
 
 if(table.unpack == nil) then table.unpack = unpack end --workaround for lua 5.2
@@ -27,66 +46,60 @@ function monteCarloCreateNode(value, parent)
 	return {value = value, parent = parent, result = 0, visit = 0, childs = {}}
 end
 
-function monteCarloSelect(node, profile)			
-	if(aif.whoWin(node.value) ~= 2) then -- terminal node that we have visited before, no need to expand
+--position is the position of node, and is moved to the position of the selected node
+--nodes are shared by positions that are rotated or mirrored versions of each other, so their children are indexed by position:keyMove
+function monteCarloSelect(node, position, profile)			
+	if(position:whoWin() ~= 2) then -- terminal node that we have visited before, no need to expand
 		return node, -1
 	end
 	
-	local num_moves = aif.getNumberOfMoves(node.value)
+	local num_moves = position:numberOfMoves()
 	local move_index = random(num_moves)-1	
+	local key_move = position:keyMove(move_index)
 	local new_game_state = nil
 	local selected_node = nil
 
-	if(node.childs[move_index] ~= nil) then		
-		--print("already exist", move_index)		
-		return node.childs[move_index], move_index
+	position:move(move_index)
+	if(node.childs[key_move] ~= nil) then		
+		--print("already exist", key_move)		
+		return node.childs[key_move], key_move
 	end
 
-	new_game_state = aif.simulate(node.value, move_index)		
+	new_game_state = position:key()
 	
 	if(profile._mc.map[new_game_state] ~= nil) then
-		node.childs[move_index] = profile._mc.map[new_game_state]
-		return profile._mc.map[new_game_state], move_index
+		node.childs[key_move] = profile._mc.map[new_game_state]
+		return profile._mc.map[new_game_state], key_move
 	end
 		
-	--print("not exist yet", move_index)	
+	--print("not exist yet", key_move)	
 	selected_node = monteCarloCreateNode(new_game_state, node)				
-	return selected_node, move_index
+	return selected_node, key_move
 end
 
-function monteCarloExpand(child, move_index, parent, profile)	
+function monteCarloExpand(child, key_move, parent, profile)	
 	profile._mc.map[child.value] = child
 	child.parent = parent	
-	parent.childs[move_index] = child	
+	parent.childs[key_move] = child	
 	profile._mc.size = profile._mc.size + 1	
 end
 
-function monteCarloSimulate(node)
-	local current_node = node
-	local num_moves = nil
-	local new_game_state = nil
-	local result = aif.whoWin(current_node.value)	
-
-	while(result == 2) do
-		num_moves = aif.getNumberOfMoves(current_node.value)
-		new_game_state = aif.simulate(current_node.value, random(num_moves)-1)
-		current_node = monteCarloCreateNode(new_game_state, current_node)		
-		result = aif.whoWin(current_node.value)		
-	end	
+--plays profile.playouts random games (1 if not given) from position until they are over, and returns the sum of their results (like whoWin) and their number
+function monteCarloSimulate(position, profile)
+	local count = profile.playouts or 1
+	local p1_wins, draws, p2_wins = position:playouts(count)
 
-	--print("result of simulation : ", result)
-	return result
+	--print("result of simulation : ", p1_wins, draws, p2_wins)
+	return p1_wins - p2_wins, count
 end
 
-function monteCarloBackPropagation(node, result)
+function monteCarloBackPropagation(node, result, count)
 	node.result = node.result + result
-	node.visit = node.visit + 1
+	node.visit = node.visit + count
 end
 
-function monteCarloSelectFinal(node)
-	local best_move_index = nil	
-	local new_game_state = nil
-	local turn = aif.getTurn(node.value)
+function monteCarloSelectFinal(node, turn)
+	local best_key_move = nil	
 	local best_move_avg = nil
 	local current_avg = nil
 	
@@ -95,13 +108,13 @@ function monteCarloSelectFinal(node)
 		--print(k, turn, v.result, v.visit, current_avg)
 		if ((best_move_avg == nil) or (turn == 1 and current_avg > best_move_avg) or (turn == 2 and current_avg < best_move_avg)) then
 			best_move_avg = current_avg
-			best_move_index = k
+			best_key_move = k
 		end
-		--print(current_avg, k, best_move_index)
+		--print(current_avg, k, best_key_move)
 	end		
 	
-	assert(best_move_index, "error on ai.lua : (monteCarlo) no move selected", turn, node.value, best_move_avg, current_avg)	
-	return best_move_index
+	assert(best_key_move, "error on ai.lua : (monteCarlo) no move selected", turn, node.value, best_move_avg, current_avg)	
+	return best_key_move
 end
 
 --menerima state game_state dengan jumlah kemungkinan move sebanyak num_moves dengan waktu proses maksimum sebanyak time
@@ -117,31 +130,36 @@ function monteCarlo(game_state, profile)
 	local last_node = nil
 	local move_index = nil
 	local root_node = nil
-	if(profile._mc.map[game_state] ~= nil) then
-		root_node = profile._mc.map[game_state]
+	local root_position = aif.newPosition(game_state)
+	local root_key = root_position:key()
+	local position = nil
+	if(profile._mc.map[root_key] ~= nil) then
+		root_node = profile._mc.map[root_key]
 	else		
-		root_node = monteCarloCreateNode(game_state, nil)
+		root_node = monteCarloCreateNode(root_key, nil)
 		profile._mc.map[root_node.value] = root_node
 	end				
 
 	while(os.clock() - start_time < time) do		
 		current_node = root_node		
+		position = root_position:copy()
+		move_index = nil
 		while(move_index ~= -1 and profile._mc.map[current_node.value] ~= nil) do			
 			last_node = current_node
-			current_node, move_index = monteCarloSelect(current_node, profile)		
+			current_node, move_index = monteCarloSelect(current_node, position, profile)		
 		end		
 		if(move_index ~= -1) then			
 			monteCarloExpand(current_node, move_index, last_node, profile)
-			local result = monteCarloSimulate(current_node) --simulate until terminal node
-			count = count + 1
+			local result, games = monteCarloSimulate(position, profile) --simulate until terminal node
+			count = count + games
 			while(current_node ~= nil) do
-				monteCarloBackPropagation(current_node, result)
+				monteCarloBackPropagation(current_node, result, games)
 				current_node = current_node.parent
 			end					
 		end
 		--print(os.clock() - start_time)
 	end	
-	local best_move = monteCarloSelectFinal(root_node)
+	local best_move = root_position:moveIndex(monteCarloSelectFinal(root_node, root_position:turn()))
 	log("best_move : ", best_move, "tree size : ",profile._mc.size, "current sim count : ", count)	
 	return best_move	
 end
@@ -150,7 +168,8 @@ end
 --kali berturut2, hanya saja berarti lawannya harus memilih langkah pass
 function miniMax(game_state, profile)
 	local depth = 1
-	local node = miniMaxCreateNode(game_state)
+	local position = aif.newPosition(game_state)
+	local node = miniMaxCreateNode(position:key())
 	local value, move_index, pv = nil,nil,nil
 	local start_time = os.clock()
 	local elapsed_time = 0
@@ -169,15 +188,16 @@ function miniMax(game_state, profile)
 	search_param.node_visit_count = 0
 	search_param.get_pv = profile.get_pv or false -- usable only if use_tt is also true
 	search_param.tt = {} -- reserved untuk transposition table (very good to be used with iterative deepening) 
+	search_param.child_values = {} -- buffer for position:childValues
 	
 	miniMaxInitTT(search_param.tt, search_param)
-	local color = aif.getTurn(game_state) == 1 and 1 or -1
+	local color = position:turn() == 1 and 1 or -1
 	
 	--fixed depth minimax
 	if(search_param.fixed_depth ~= nil) then
 		search_param.max_time = math.huge
-		value, move_index = miniMaxRec(node, search_param.fixed_depth, color, math.huge * -1, math.huge, search_param)						
-		if(search_param.get_pv) then pv = miniMaxGetPv(search_param.tt, node) end
+		value, move_index = miniMaxRec(node, position, search_param.fixed_depth, color, math.huge * -1, math.huge, search_param)						
+		if(search_param.get_pv) then pv = miniMaxGetPv(search_param.tt, node, position) end
 		
 		log("miniMax","value : ",value,"best_move_index : ",move_index, "depth : ", search_param.fixed_depth, "time : ", search_param.max_time, "tt count : ",search_param.tt.count, "node visited count : ",search_param.node_visit_count, "pv : ", unpack(pv or {}))
 		
@@ -187,9 +207,9 @@ function miniMax(game_state, profile)
 	--iterative deepening minimax	
 	repeat
 		search_param.node_visit_count = 0
-		value, move_index = miniMaxRec(node, depth, color, math.huge * -1, math.huge, search_param)						
+		value, move_index = miniMaxRec(node, position, depth, color, math.huge * -1, math.huge, search_param)						
 		elapsed_time = os.clock() - start_time		
-		if(search_param.get_pv) then pv = miniMaxGetPv(search_param.tt, node) end
+		if(search_param.get_pv) then pv = miniMaxGetPv(search_param.tt, node, position) end
 		
 		log("miniMax", "value : ",value, "best_move_index : ",move_index, "depth : ",depth, "time : ",search_param.max_time, "tt count : ",search_param.tt.count, "node visited count : ",search_param.node_visit_count, "pv : ", unpack(pv or {}))
 		
@@ -209,32 +229,47 @@ function miniMaxCreateNode(state)
 end
 
 --return -1 if we ran out of time (negamax)
-function miniMaxRec(node, depth, color, min, max, search_param)	
+--position is the position of node. node.state is only set if the transposition table is used
+function miniMaxRec(node, position, depth, color, min, max, search_param)	
 	--log("visit", node.state, depth, min, max)
 	
 	search_param.node_visit_count = search_param.node_visit_count + 1
-	local winner = aif.whoWin(node.state)
+	local winner = position:whoWin()
 	if(winner == 1) then
 		return math.huge
 	elseif(winner == -1) then
 		return math.huge*-1
 	elseif(winner == 0 or depth == 0) then -- seri atau sudah mencapai depth paling bawah		
-		return aif.evaluate(node.state) * color
+		return position:evaluate() * color
 	end
 	
-	local num_of_moves = aif.getNumberOfMoves(node.state)	
-	assert(num_of_moves > 0, "this state : " .. (node.state) .. " doesnt have any moves. every node that is not a terminal node should have legal moves >= 1")
+	local num_of_moves = position:numberOfMoves()	
+	assert(num_of_moves > 0, "every node that is not a terminal node should have legal moves >= 1")
 	local v_t = nil
 	local best_move_index = nil		
-	local move_indexes = miniMaxOrderMoves(node, true, num_of_moves, depth, search_param) -- one- based array
+	local move_indexes = miniMaxOrderMoves(node, position, true, num_of_moves, depth, search_param) -- one- based array
+	local child_values = nil
+	if(depth == 1) then -- the children are all leaves, get their values in one call instead of visiting them
+		child_values = position:childValues(search_param.child_values)
+	end
 	
 	for i=1, #move_indexes do						
-		local child_node = miniMaxCreateNode(aif.simulate(node.state, move_indexes[i]))
-		if(os.clock() - search_param.start_time > search_param.max_time) then return -1,-1 end -- ran out of time			
-		v_t = -miniMaxRec(child_node, depth-1, color*-1, -max, -min, search_param)			
+		if(child_values) then
+			if(os.clock() - search_param.start_time > search_param.max_time) then return -1,-1 end -- ran out of time
+			search_param.node_visit_count = search_param.node_visit_count + 1
+			v_t = child_values[move_indexes[i] + 1] -- what miniMaxRec returns for the child
+			if(v_t ~= math.huge and v_t ~= math.huge * -1) then v_t = v_t * color * -1 end
+			v_t = -v_t
+		else
+			position:move(move_indexes[i])
+			local child_node = miniMaxCreateNode(search_param.use_tt and position:key() or nil)
+			if(os.clock() - search_param.start_time > search_param.max_time) then position:undo() return -1,-1 end -- ran out of time			
+			v_t = -miniMaxRec(child_node, position, depth-1, color*-1, -max, -min, search_param)			
+			position:undo()
+		end
 		if(v_t >= max) then 											
 			if(best_move_index == nil) then best_move_index = move_indexes[i] end
-			if(search_param.use_tt) then miniMaxInsertNodeTT(search_param.tt, node, aif.getTurn(node.state) == 1, max, best_move_index, depth) end
+			if(search_param.use_tt) then miniMaxInsertNodeTT(search_param.tt, node, position:turn() == 1, max, position:keyMove(best_move_index), depth) end
 			--log("value", node.state, best_move_index, max, v_t)
 			return max, best_move_index -- prune 
 		end 		
@@ -245,12 +280,13 @@ function miniMaxRec(node, depth, color, min, max, search_param)
 	end				
 	
 	if(best_move_index == nil) then best_move_index = move_indexes[random(1, num_of_moves)] end -- randomize equal valued moves
-	if(search_param.use_tt) then miniMaxInsertNodeTT(search_param.tt, node, aif.getTurn(node.state) == 1, min, best_move_index, depth) end
+	if(search_param.use_tt) then miniMaxInsertNodeTT(search_param.tt, node, position:turn() == 1, min, position:keyMove(best_move_index), depth) end
 	--log("value", node.state, best_move_index)		
 	return min, best_move_index
 end
 
-function miniMaxOrderMoves(cur_node, is_max, num_of_moves, depth, search_param) 
+--position is the position of cur_node
+function miniMaxOrderMoves(cur_node, position, is_max, num_of_moves, depth, search_param) 
 	local ret = {}
 	for i=1, num_of_moves do
 		ret[i] = i-1
@@ -258,7 +294,7 @@ function miniMaxOrderMoves(cur_node, is_max, num_of_moves, depth, search_param)
 	
 	if(not search_param.no_tt_move_ordering and search_param.use_tt and search_param.tt[cur_node.state]) then
 		local entry = search_param.tt[cur_node.state]
-		local best_move_index = entry.best_move_index		
+		local best_move_index = position:moveIndex(entry.best_move)		
 		ret[1] = best_move_index
 		ret[best_move_index + 1] = 0		
 	end	
@@ -266,7 +302,8 @@ function miniMaxOrderMoves(cur_node, is_max, num_of_moves, depth, search_param)
 	return ret
 end
 
-function miniMaxInsertNodeTT(tt, node, is_max, subtree_eval, best_move_index, depth)		
+--the tt is keyed by position:key(), so best_move is stored as given by position:keyMove
+function miniMaxInsertNodeTT(tt, node, is_max, subtree_eval, best_move, depth)		
 	if(tt[node.state] == nil) then -- node sudah ada
 		if(tt.count > tt.max_count) then
 			miniMaxRandomDeleteTT(tt)
@@ -275,13 +312,13 @@ function miniMaxInsertNodeTT(tt, node, is_max, subtree_eval, best_move_index, de
 		node.is_max = is_max
 		node.subtree_eval = subtree_eval
 		node.depth = depth
-		node.best_move_index = best_move_index								
+		node.best_move = best_move								
 		tt.count = tt.count + 1		
 	else -- update
 		local entry = tt[node.state]
 		if(depth > entry.depth) then			
 			entry.depth = depth
-			entry.best_move_index = best_move_index
+			entry.best_move = best_move
 			entry.subtree_eval = subtree_eval		
 		end
 	end
@@ -311,13 +348,15 @@ function miniMaxInitTT(tt, profile)
 	tt.sweep_count = profile.tt_sweep_count or 500 	
 end
 
-function miniMaxGetPv(tt, node) 
+function miniMaxGetPv(tt, node, position) 
 	local pv = {}
+	position = position:copy()
 
 	while(node ~= nil) do
-		table.insert(pv, node.best_move_index)
-		local next_game_state = aif.simulate(node.state, node.best_move_index)
-		node = tt[next_game_state]
+		local move_index = position:moveIndex(node.best_move)
+		table.insert(pv, move_index)
+		position:move(move_index)
+		node = tt[position:key()]
 	end
 	
 	return pv
@@ -338,11 +377,3 @@ function exec(profile, game_state)
 	return func_table[profile.type](game_state, profile)
 end
 
---profile_1 as P1 and profile_2 as P2
-function fight(profile_1, profile_2, game_state)
-	local turn = aif.getTurn(game_state)
-	--while(aif.whoWin() == ) do
-	
-	--end
-end
-
@@ -1,15 +1,39 @@
 local default_monte_carlo = {type = "monte_carlo",time = 5,}
+local monte_carlo_many_playouts = {type = "monte_carlo", time = 5, playouts = 32,} -- plays 32 games from every new node, in one call to C++
 local default_minimax = {type = "minimax", time = 5, use_tt = true,}
 local fast_minimax = {type = "minimax", time = 2, use_tt = true,}
 local minimax_without_tt = {type = "minimax", time = 5,}
 local minimax_max_depth_with_tt = {type = "minimax", max_depth = 8, use_tt = true}
 local minimax_max_depth_with_tt_no_move_ordering = {type = "minimax", max_depth = 6, use_tt = true, no_tt_move_ordering = true}
+local native_alphabeta = {type = "alphabeta",} -- searched by the C++ engine, depth follows the skill level
+local native_alphabeta_timed = {type = "alphabeta", time = 2,} -- iterative deepening until the time is used
+local native_alphabeta_smp = {type = "alphabeta", time = 2, threads = 0,} -- one search thread per core
+local native_alphabeta_no_book = {type = "alphabeta", time = 2, book = false,} -- searches the opening too
+local native_alphabeta_selective = {type = "alphabeta", time = 2, selectivity = 2,} -- prunes with multi-probcut to search deeper
+local native_alphabeta_ponder = {type = "alphabeta", time = 2, ponder = true,} -- also thinks while the player does
+local native_mcts = {type = "mcts", time = 2,} -- monte carlo tree search in C++, keeps its tree between moves
+local native_mcts_puct = {type = "mcts", time = 2, selection = "puct", exploration = 2,} -- the same, guided by square values
+local native_mcts_smp = {type = "mcts", time = 2, threads = 0,} -- all cores search one tree
+local native_mcts_root_parallel = {type = "mcts", time = 2, threads = 0, parallel = "root",} -- every core searches a tree of its own
+local native_mcts_ponder = {type = "mcts", time = 2, ponder = true,} -- grows its tree while the player thinks
 
 local profiles = {	
 	default_monte_carlo = default_monte_carlo, 
+	monte_carlo_many_playouts = monte_carlo_many_playouts, 
 	default_minimax = default_minimax, 
 	minimax_without_tt = minimax_without_tt, 
 	minimax_max_depth_with_tt = minimax_max_depth_with_tt, 
+	native_alphabeta = native_alphabeta, 
+	native_alphabeta_timed = native_alphabeta_timed, 
+	native_alphabeta_smp = native_alphabeta_smp, 
+	native_alphabeta_no_book = native_alphabeta_no_book, 
+	native_alphabeta_selective = native_alphabeta_selective, 
+	native_alphabeta_ponder = native_alphabeta_ponder, 
+	native_mcts = native_mcts, 
+	native_mcts_puct = native_mcts_puct, 
+	native_mcts_smp = native_mcts_smp, 
+	native_mcts_root_parallel = native_mcts_root_parallel, 
+	native_mcts_ponder = native_mcts_ponder, 
         my_ai_1 = fast_minimax,--{type = "minimax", max_depth = 6, use_tt = true},
         my_ai_2 = fast_minimax,--{type = "minimax", max_depth = 3, use_tt = true},
 }
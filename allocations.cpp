@@ -0,0 +1,204 @@
+// kreversi-allocations checks that a search of Engine does not allocate
+// memory for the nodes it searches.  It searches a number of positions
+// from random games to the same depth, counting the memory allocations of
+// every search, and fails if some searches allocate more than others:
+// their node counts differ a lot, so an allocation per node, or per some
+// of the nodes, would show.
+//
+// What a search allocates anyway, such as the list of the values of its
+// iterations and the debug output, is the same for every search of the
+// same depth, except for a little debug output, which is allowed for.
+//
+// Qt's containers allocate with malloc() rather than operator new, so on
+// glibc the malloc() family is counted too.  Elsewhere only operator new
+// is.
+
+#include <kaboutdata.h>
+#include <kcmdlineargs.h>
+#include <klocale.h>
+
+#include <QCoreApplication>
+#include <QTextStream>
+#include <cstdlib>
+#include <new>
+
+#include "Engine.h"
+#include "Position.h"
+
+// Allowed difference between the allocations of two searches.
+static const long ALLOCATION_SLACK = 16;
+
+// Pieces on the board in the positions that are searched.
+static const int POSITION_PIECES = 24;
+
+static long  s_allocations = 0;
+
+#ifdef __GLIBC__
+
+extern "C" {
+  void* __libc_malloc(size_t size);
+  void* __libc_calloc(size_t count, size_t size);
+  void* __libc_realloc(void* pointer, size_t size);
+}
+
+static inline void* countedMalloc(size_t size)
+{
+  s_allocations++;
+  return __libc_malloc(size);
+}
+
+extern "C" void* malloc(size_t size)
+{
+  return countedMalloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+  s_allocations++;
+  return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size)
+{
+  s_allocations++;
+  return __libc_realloc(pointer, size);
+}
+
+#else
+
+static inline void* countedMalloc(size_t size)
+{
+  s_allocations++;
+  return std::malloc(size);
+}
+
+#endif
+
+void* operator new(size_t size) throw(std::bad_alloc)
+{
+  void* pointer = countedMalloc(size > 0 ? size : 1);
+  if (pointer == 0)
+    throw std::bad_alloc();
+
+  return pointer;
+}
+
+void* operator new[](size_t size) throw(std::bad_alloc)
+{
+  return operator new(size);
+}
+
+void operator delete(void* pointer) throw()
+{
+  std::free(pointer);
+}
+
+void operator delete[](void* pointer) throw()
+{
+  std::free(pointer);
+}
+
+
+// xorshift64*, so that every run searches the same positions.
+static quint64 nextRandom(quint64& state)
+{
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * Q_UINT64_C(2685821657736338717);
+}
+
+
+// Play random moves from the start until there are POSITION_PIECES
+// pieces on the board.  Returns false if the game ends before, or the
+// side to move has to pass.
+
+static bool randomPosition(Position& position, quint64& random)
+{
+  position = Position();
+
+  while (bitCount(position.bits(Black) | position.bits(White)) < POSITION_PIECES) {
+    if (position.legalMoves() == 0)
+      return false;
+    position.makeMove(nextRandom(random) % position.numberOfMoves());
+  }
+
+  return position.legalMoves() != 0;
+}
+
+
+int main(int argc, char **argv)
+{
+  // The application name is the one of the game, so that the searches
+  // use the pattern weights the game uses.
+  KAboutData aboutData("kreversi", 0, ki18n("KReversi Allocation Check"),
+		       "1.0", ki18n("Checks that the KReversi search does not allocate memory per node"),
+		       KAboutData::License_GPL);
+
+  KCmdLineArgs::init(argc, argv, &aboutData);
+
+  KCmdLineOptions options;
+  options.add("d");
+  options.add("depth <number>", ki18n("Depth to search the positions to"), "6");
+  options.add("p");
+  options.add("positions <number>", ki18n("Number of positions to search"), "20");
+  KCmdLineArgs::addCmdLineOptions(options);
+
+  QCoreApplication app(KCmdLineArgs::qtArgc(), KCmdLineArgs::qtArgv());
+  KCmdLineArgs *args = KCmdLineArgs::parsedArgs();
+  QTextStream out(stdout);
+
+  int depth     = qBound(1, args->getOption("depth").toInt(), 64 - POSITION_PIECES - 6);
+  int positions = qMax(args->getOption("positions").toInt(), 2);
+  args->clear();
+
+  Engine    engine(depth);
+  Position  position;
+  quint64   random = Q_UINT64_C(0x2545F4914F6CDD1D);
+
+  // The first search allocates the transposition table and loads the
+  // pattern weights, so it is not counted.
+  while (!randomPosition(position, random))
+    ;
+  engine.setGameState(position.gameStateString());
+  engine.searchMove();
+
+  long     min_allocations = 0;
+  long     max_allocations = 0;
+  quint64  min_nodes       = 0;
+  quint64  max_nodes       = 0;
+
+  for (int i = 0; i < positions; i++) {
+    while (!randomPosition(position, random))
+      ;
+    engine.setGameState(position.gameStateString());
+
+    long before = s_allocations;
+    engine.searchMove();
+    long allocations = s_allocations - before;
+
+    quint64 nodes = engine.nodesSearched();
+    out << "position " << i + 1 << ": " << nodes << " nodes, "
+	<< allocations << " allocations" << endl;
+
+    if (i == 0 || allocations < min_allocations)
+      min_allocations = allocations;
+    if (i == 0 || allocations > max_allocations)
+      max_allocations = allocations;
+    if (i == 0 || nodes < min_nodes)
+      min_nodes = nodes;
+    if (i == 0 || nodes > max_nodes)
+      max_nodes = nodes;
+  }
+
+  out << "nodes " << min_nodes << " to " << max_nodes << ", allocations "
+      << min_allocations << " to " << max_allocations << endl;
+
+  if (max_allocations - min_allocations > ALLOCATION_SLACK) {
+    out << "FAILED: the allocations of a search grow with its nodes" << endl;
+    return 1;
+  }
+
+  out << "passed" << endl;
+  return 0;
+}
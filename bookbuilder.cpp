@@ -0,0 +1,181 @@
+// kreversi-bookbuilder builds the opening book (see OpeningBook.h) from a
+// collection of games, and writes it to a book file that Engine maps at
+// startup.
+//
+// The games are read in the same format as kreversi-trainer reads them:
+// one game per line, written as the squares of the moves ("f5d6c3..."),
+// with empty lines and lines starting with '#' skipped. kreversi-tournament
+// writes its games in this format, so a book can be built from self-play
+// as well as from imported game collections.
+//
+// Every move of the first plies of a game is counted for the position it
+// was played in, together with the points the side that played it got in
+// the end. Moves that were played in fewer than a minimum number of games
+// are left out, since their win rates say little.
+
+#include <kaboutdata.h>
+#include <kcmdlineargs.h>
+#include <klocale.h>
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QHash>
+#include <QPair>
+#include <QTextStream>
+#include <QVector>
+
+#include "Bitboard.h"
+#include "OpeningBook.h"
+#include "Symmetry.h"
+
+// How often a move was played in a position, and how it did.
+class MoveStats
+{
+public:
+  MoveStats() : m_games(0), m_half_points(0) {}
+
+  int  m_games;
+  int  m_half_points;    // 2 for a win, 1 for a draw
+};
+
+// Moves by the key of the canonical form of their position and their
+// square in it.
+typedef QHash<QPair<quint64, int>, MoveStats> MoveTable;
+
+
+// Replay the game in line and count its first plies moves in table.
+// Returns false if the game is illegal or does not reach the end, and
+// then counts nothing.
+
+static bool addGame(const QString& line, int plies, MoveTable& table)
+{
+  quint64 bits[2];
+  bits[White] = squareBit(27) | squareBit(36);
+  bits[Black] = squareBit(28) | squareBit(35);
+
+  ChipColor turn = Black;
+
+  // The moves to count, and the side that made them.
+  QVector<QPair<quint64, int> >  moves;
+  QVector<ChipColor>             movers;
+
+  for (int i = 0; i + 1 < line.size(); i += 2) {
+    int col = line[i].toLower().toLatin1() - 'a';
+    int row = line[i + 1].toLatin1() - '1';
+    if (col < 0 || col > 7 || row < 0 || row > 7)
+      return false;
+
+    ChipColor opponent = turn == Black ? White : Black;
+    if (legalMoveBits(bits[turn], bits[opponent]) == 0)
+      qSwap(turn, opponent);
+
+    int     square  = row * 8 + col;
+    quint64 flipped = 0;
+    if (!(bits[turn] & squareBit(square)) && !(bits[opponent] & squareBit(square)))
+      flipped = flippedBits(square, bits[turn], bits[opponent]);
+    if (flipped == 0)
+      return false;
+
+    if (moves.size() < plies) {
+      CanonicalForm canonical(bits[Black], bits[White]);
+      moves.append(qMakePair(OpeningBook::canonicalKey(bits[Black], bits[White], turn),
+			     canonical.canonicalSquare(square)));
+      movers.append(turn);
+    }
+
+    bits[turn]     |= flipped | squareBit(square);
+    bits[opponent] &= ~flipped;
+    turn = opponent;
+  }
+
+  if (legalMoveBits(bits[White], bits[Black]) != 0
+      || legalMoveBits(bits[Black], bits[White]) != 0)
+    return false;
+
+  int result = bitCount(bits[Black]) - bitCount(bits[White]);
+  for (int i = 0; i < moves.size(); i++) {
+    MoveStats& stats = table[moves[i]];
+    int        score = movers[i] == Black ? result : -result;
+
+    stats.m_games++;
+    stats.m_half_points += score > 0 ? 2 : score == 0 ? 1 : 0;
+  }
+
+  return true;
+}
+
+
+int main(int argc, char **argv)
+{
+  KAboutData aboutData("kreversi-bookbuilder", "kreversi", ki18n("KReversi Book Builder"),
+		       "1.0", ki18n("Builds the KReversi opening book from a collection of games"),
+		       KAboutData::License_GPL);
+
+  KCmdLineArgs::init(argc, argv, &aboutData);
+
+  KCmdLineOptions options;
+  options.add("o");
+  options.add("output <file>", ki18n("Book file to write"), "opening_book.bin");
+  options.add("p");
+  options.add("plies <number>", ki18n("Number of moves of each game to put in the book"), "20");
+  options.add("m");
+  options.add("min-games <number>", ki18n("Leave out moves played in fewer games than this"), "2");
+  options.add("+games", ki18n("Files with one game per line"));
+  KCmdLineArgs::addCmdLineOptions(options);
+
+  QCoreApplication app(KCmdLineArgs::qtArgc(), KCmdLineArgs::qtArgv());
+  KCmdLineArgs *args = KCmdLineArgs::parsedArgs();
+  QTextStream out(stdout);
+
+  int plies     = args->getOption("plies").toInt();
+  int min_games = qMax(args->getOption("min-games").toInt(), 1);
+
+  // Read the games.
+  MoveTable table;
+  int games   = 0;
+  int skipped = 0;
+
+  for (int i = 0; i < args->count(); i++) {
+    QFile file(args->arg(i));
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+      out << "cannot open " << args->arg(i) << endl;
+      return 1;
+    }
+
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+      QString line = in.readLine().trimmed();
+      if (line.isEmpty() || line.startsWith('#'))
+	continue;
+
+      if (addGame(line, plies, table))
+	games++;
+      else
+	skipped++;
+    }
+  }
+
+  QVector<BookEntry> entries;
+  for (MoveTable::const_iterator it = table.constBegin(); it != table.constEnd(); ++it) {
+    if (it.value().m_games < min_games)
+      continue;
+
+    BookEntry entry;
+    entry.m_key             = it.key().first;
+    entry.m_move.m_square   = it.key().second;
+    entry.m_move.m_games    = it.value().m_games;
+    entry.m_move.m_win_rate = qint64(5000) * it.value().m_half_points / it.value().m_games;
+    entries.append(entry);
+  }
+
+  out << games << " games, " << skipped << " games skipped, "
+      << table.size() << " moves, " << entries.size() << " in the book" << endl;
+
+  if (!OpeningBook::save(args->getOption("output"), entries)) {
+    out << "cannot write " << args->getOption("output") << endl;
+    return 1;
+  }
+
+  args->clear();
+  return 0;
+}
@@ -24,10 +24,11 @@
 
 #include <kdebug.h>
 
-#include "Engine.h"
+#include "AiWorker.h"
 
 KReversiGame::KReversiGame()
-    : m_curPlayer(Black), m_playerColor(Black), m_computerColor( White )
+    : m_curPlayer(Black), m_playerColor(Black), m_computerColor( White ),
+    m_moveRequest(-1), m_hintRequest(-1)
 {
     kDebug() << "ctor kReversiGame";        
     ai[0] = new Ai("my_ai_1");
@@ -43,14 +44,17 @@ KReversiGame::KReversiGame()
 
     m_score[White] = m_score[Black] = 2;
 
-    m_engine = new Engine(1);    
+    m_worker = new AiWorker(this);
+    connect( m_worker, SIGNAL(moveComputed(int,KReversiPos)),
+             SLOT(slotMoveComputed(int,KReversiPos)) );
 }
 
 KReversiGame::~KReversiGame()
 {
+    // the worker may still be using the ais
+    delete m_worker;
     delete ai[0];
     delete ai[1];
-    delete m_engine;
 }
 
 Ai* KReversiGame::getAi(ChipColor color) const
@@ -64,23 +68,30 @@ Ai* KReversiGame::getAi(ChipColor color) const
 void KReversiGame::makePlayerMove( int row, int col, bool demoMode )
 {
     m_curPlayer = m_playerColor;
-    KReversiPos move;
 
-    if( !demoMode )
-        move = KReversiPos( m_playerColor, row, col );
-    else
+    if( demoMode )
     {
-        move = m_engine->computeMove( *this, true );
-        if( !move.isValid() )
-            return;
+        // the move is made in slotMoveComputed()
+        m_moveRequest = m_worker->computeMove( true );
+        m_hintRequest = -1;
+        return;
     }
 
+    KReversiPos move( m_playerColor, row, col );
     if( !isMovePossible(move) )
     {
         kDebug() << "No move possible. Stupid";
         return;
     }
     //kDebug() << "Black (player) play ("<<move.row<<","<<move.col<<")";
+
+    // a hint that is still being looked for is of no use anymore
+    if( m_hintRequest != -1 )
+    {
+        m_worker->cancel();
+        m_hintRequest = -1;
+    }
+
     makeMove( move );
     m_undoStack.push( m_changedChips );
 }
@@ -103,6 +114,9 @@ void KReversiGame::startNextTurn(bool demoMode)
             {
                 kDebug() << "Computer can't move!";
                 m_curPlayer = m_playerColor;
+                // what the computer pondered on is of no use now
+                m_worker->cancel();
+                m_worker->ponder();
                 emit computerCantMove();
             }
         }
@@ -118,11 +132,16 @@ void KReversiGame::startNextTurn(bool demoMode)
             {
                 makePlayerMove( -1, -1, true );
             }
+            else // let the computer think while the player does
+            {
+                m_worker->ponder();
+            }
         }
     }
     else
     {
         kDebug() << "GAME OVER";
+        m_worker->cancel();
         emit gameOver();
     }
 }
@@ -131,14 +150,34 @@ void KReversiGame::makeComputerMove()
 {
     m_curPlayer = m_computerColor;
     // FIXME dimsuz: m_competitive. Read from config.
-    // (also there's computeMove in getHint)
-    KReversiPos move = m_engine->computeMove( *this, true );
+    // (also there's computeMove in requestHint)
+    // the move is made in slotMoveComputed()
+    m_moveRequest = m_worker->computeMove( true );
+    m_hintRequest = -1;
+}
+
+void KReversiGame::slotMoveComputed( int request, const KReversiPos& move )
+{
+    if( request == m_hintRequest )
+    {
+        m_hintRequest = -1;
+        // the hint stopped the pondering
+        m_worker->ponder();
+        if( move.isValid() )
+            emit hintComputed( move );
+        return;
+    }
+
+    if( request != m_moveRequest )
+        return;
+    m_moveRequest = -1;
+
     if( !move.isValid() )
         return;
 
-    if( move.color != m_computerColor )
+    if( move.color != m_curPlayer || !isMovePossible(move) )
     {
-        kDebug() << "Strange! makeComputerMove() just got not computer move!";
+        kDebug() << "Strange! The AI just got a move that is not possible!";
         return;
     }
 
@@ -152,6 +191,10 @@ int KReversiGame::undo()
     // We undo that player move too and we're done.
     // Simply put: we're undoing all_moves_of_computer + one_move_of_player
 
+    // whatever the computer is thinking about, it's too late now
+    m_worker->cancel();
+    m_moveRequest = m_hintRequest = -1;
+
     int movesUndone = 0;
 
     while( !m_undoStack.isEmpty() )
@@ -186,6 +229,7 @@ int KReversiGame::undo()
     }
 
     m_curPlayer = m_playerColor;
+    m_worker->ponder();
 
     kDebug() << "Undone" << movesUndone << "moves.";
     //kDebug() << "Current player changed to" << (m_curPlayer == White ? "White" : "Black" );
@@ -494,10 +538,7 @@ bool KReversiGame::hasChunk( Direction dir, const KReversiPos& move ) const
 
 bool KReversiGame::isThinking() const
 {
-    if( !m_engine )
-        return false;
-
-    return m_engine->isThinking();
+    return m_moveRequest != -1;
 }
 
 bool KReversiGame::isGameOver() const
@@ -541,13 +582,16 @@ bool KReversiGame::isAnyComputerMovePossible() const
 
 void KReversiGame::setComputerSkill(int skill)
 {
-    m_engine->setStrength( skill );
+    m_worker->setStrength( skill );
 }
 
-KReversiPos KReversiGame::getHint() const
+void KReversiGame::requestHint()
 {
+    if( m_hintRequest != -1 || isThinking() )
+        return;
+
     // FIXME dimsuz: don't use true, use m_competitive
-    return m_engine->computeMove( *this, true );
+    m_hintRequest = m_worker->computeMove( true );
 }
 
 KReversiPos KReversiGame::getLastMove() const
@@ -29,7 +29,7 @@
 #include "commondefs.h"
 #include "ai.h"
 
-class Engine;
+class AiWorker;
 
 /**
  *  KReversiGame incapsulates all of the game logic.
@@ -61,7 +61,8 @@ public:
      *  - if it is computer turn and computer can't move it'll emit "computerCantMove"
      *  signal and exit
      *  - if it is player turn and player can move then this function
-     *  will do nothing - you can call makePlayerMove(row,col) to make player move (but see last item)
+     *  will only let the computer ponder on the player's time - you can call
+     *  makePlayerMove(row,col) to make player move (but see last item)
      *  - if it is player turn and player can't move it'll make a computer move
      *  - in demo mode this function will make computer play player moves,
      *  so you don't need to call makePlayerMove.
@@ -78,18 +79,22 @@ public:
     /**
      *  This will make the player move at row, col.
      *  If that is possible of course
-     *  If demoMode is true, the computer will decide on what move to take.
+     *  If demoMode is true, the computer will decide on what move to take
+     *  (and make it later, like makeComputerMove()).
      *  row and col values do not matter in that case.
      */
     void makePlayerMove(int row, int col, bool demoMode);
     /**
      *  This function will make computer decide where he
      *  wants to put his chip... and he'll put it there!
+     *  The computer thinks in another thread, so the move is made
+     *  later, when it is found.
      */
     void makeComputerMove();
     /**
      *  Undoes all the computer moves and one player move
      *  (so after calling this function it will be player turn)
+     *  If the computer is thinking, it stops.
      *  @return number of undone moves
      */
     int undo();
@@ -131,9 +136,10 @@ public:
      */
     bool canUndo() const { return !m_undoStack.isEmpty(); }
     /**
-     *  @return a hint to current player
+     *  Starts looking for a hint to current player.
+     *  hintComputed() is emitted when it is found.
      */
-    KReversiPos getHint() const;
+    void requestHint();
     /**
      *  @return last move made
      */
@@ -158,6 +164,9 @@ signals:
     void moveFinished();
     void computerCantMove();
     void playerCantMove();
+    void hintComputed(const KReversiPos& hint);
+private slots:
+    void slotMoveComputed(int request, const KReversiPos& move);
 private:
     Ai* ai[2];
     enum Direction { Up, Down, Right, Left, UpLeft, UpRight, DownLeft, DownRight };
@@ -206,9 +215,15 @@ private:
      */
     ChipColor m_computerColor;
     /**
-     *  Our AI
+     *  Our AI, which thinks in a thread of its own
      */
-    Engine *m_engine;
+    AiWorker *m_worker;
+    /**
+     *  Requests to m_worker for the next move and for a hint,
+     *  -1 if there are none
+     */
+    int m_moveRequest;
+    int m_hintRequest;
      // Well I'm not brief at all :). That's because I think that my
      // English is not well shaped sometimes, so I try to describe things
      // so that me and others can understand. Even simple things.
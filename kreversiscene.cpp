@@ -44,7 +44,7 @@ static KgTheme* theme()
 
 KReversiScene::KReversiScene( KReversiGame* game , const QString& chipsPrefix )
     : m_renderer(theme()), m_game(0),
-    m_pendingNewGame(0), m_hintChip(0), m_lastMoveChip(0), m_timerDelay(25),
+    m_hintChip(0), m_lastMoveChip(0), m_timerDelay(25),
     m_showingHint(false), m_demoMode(false), m_showLastMove(false), m_showPossibleMoves(false),
     m_showLabels(false)
 {
@@ -124,23 +124,10 @@ void KReversiScene::setShowBoardLabels( bool show )
 
 void KReversiScene::setGame( KReversiGame* game )
 {
-    // if animation is running or we are thinking save this game in pending var.
-    // It will be made current animation slot will get called
-    // @see setNewGameObject and @see slotAnimationStep
-    //
-    // NOTE: all this magic is needed for game not to crash while pressing new game:
-    // if we'd simply set the new object right away and deleted an old one, slotAnimationStep
-    // might got called *after* this, trying to do smth with already deleted object.
-    // For example see BUG #154946
-    // So we postpone the setting && deletion...
-    if( m_animTimer->isActive() || ( m_game && m_game->isThinking() ) )
-        m_pendingNewGame = game;
-    else
-        setNewGameObject( game );
-}
-
-void KReversiScene::setNewGameObject( KReversiGame* game )
-{
+    // NOTE: the old game can be deleted right away. The computer thinks in
+    // a thread of its own (which the game stops when it's deleted), so
+    // we can't be called from inside its move, and once the animation
+    // timer is stopped nothing else uses it. (See BUG #154946)
     m_animTimer->stop();
 
     // disconnect signals from previous game if it exists,
@@ -152,6 +139,7 @@ void KReversiScene::setNewGameObject( KReversiGame* game )
         disconnect( m_game, SIGNAL(gameOver()), this, SLOT(slotGameOver()) );
         disconnect( m_game, SIGNAL(computerCantMove()), this, SLOT(slotComputerCantMove()) );
         disconnect( m_game, SIGNAL(playerCantMove()), this, SLOT(slotPlayerCantMove()) );
+        disconnect( m_game, SIGNAL(hintComputed(KReversiPos)), this, SLOT(slotHintComputed(KReversiPos)) );
     }
 
     // delete old object
@@ -159,13 +147,12 @@ void KReversiScene::setNewGameObject( KReversiGame* game )
 
     m_game = game;
 
-    m_pendingNewGame = 0; // it's made official now ;)
-
     connect( m_game, SIGNAL(boardChanged()), SLOT(updateBoard()) );
     connect( m_game, SIGNAL(moveFinished()), SLOT(slotGameMoveFinished()) );
     connect( m_game, SIGNAL(gameOver()), SLOT(slotGameOver()) );
     connect( m_game, SIGNAL(computerCantMove()), SLOT(slotComputerCantMove()) );
     connect( m_game, SIGNAL(playerCantMove()), SLOT(slotPlayerCantMove()) );
+    connect( m_game, SIGNAL(hintComputed(KReversiPos)), SLOT(slotHintComputed(KReversiPos)) );
 
     // this will remove all chips left from previous game
     QList<QGraphicsItem*> allItems = items();
@@ -313,14 +300,6 @@ void KReversiScene::slotGameMoveFinished()
 
 void KReversiScene::slotAnimationStep()
 {
-    if( m_pendingNewGame != 0 )
-    {
-	// aha! we have new game waiting for us
-	m_animTimer->stop();
-	setNewGameObject( m_pendingNewGame );
-	return;
-    }
-
     if(m_changedChips.isEmpty() && !m_showingHint)
     {
         m_animTimer->stop();
@@ -426,8 +405,13 @@ void KReversiScene::slotHint()
         kDebug() << "Don't you see I'm animating? Be patient, human child...";
         return;
     }
-    KReversiPos hint = m_game->getHint();
-    if( !hint.isValid() )
+    m_game->requestHint();
+}
+
+void KReversiScene::slotHintComputed( const KReversiPos& hint )
+{
+    // the player may have been faster
+    if( m_game->isComputersTurn() || m_animTimer->isActive() )
         return;
     if( m_hintChip == 0 )
         m_hintChip = new KReversiChip( &m_renderer, hint.color, m_chipsPrefix, m_curCellSize, this );
@@ -58,7 +58,7 @@ public:
 
     /**
      *  Sets the game object which this scene will visualize/use.
-     *  KReversiScene takes ownership of this object and will delete it when appropriate
+     *  KReversiScene takes ownership of this object and deletes the previous one
      */
     void setGame( KReversiGame* game );
     /**
@@ -109,7 +109,7 @@ public slots:
      */
     void setShowLegalMoves( bool show );
     /**
-     *  Shows hint for player
+     *  Asks the game for a hint for player, which is shown when it's found
      */
     void slotHint();
     /**
@@ -130,6 +130,7 @@ private slots:
     void slotGameOver();
     void slotComputerCantMove();
     void slotPlayerCantMove();
+    void slotHintComputed( const KReversiPos& hint );
 signals:
     /**
      *  emitted when Scene finishes displaying last move
@@ -145,11 +146,6 @@ private:
      *  Mouse presses event handler
      */
     virtual void mousePressEvent( QGraphicsSceneMouseEvent* );
-    /**
-     *  Makes pending new game object a current one.
-     *  @see m_pendingNewGame @see setGame
-     */
-    void setNewGameObject( KReversiGame* game );
     /**
      *  Visually displays last move and possible moves
      *  (if the scene is set up to show them)
@@ -179,11 +175,6 @@ private:
      *  The Game object
      */
     KReversiGame *m_game;
-    /**
-     *  This pointer is meant for temporal storage of new game object being set.
-     *  New game object is *actually* set after animation slot gets called by timer
-     */
-    KReversiGame *m_pendingNewGame;
     /**
      * The SVG element prefix for the current chip set
      */
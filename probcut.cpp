@@ -0,0 +1,348 @@
+// kreversi-probcut fits the parameters of Multi-ProbCut (see ProbCut.h)
+// to searches of positions from a collection of games, and writes them
+// to a parameter file that Engine reads at startup.
+//
+// The games are read in the same format as kreversi-trainer reads them,
+// so the games kreversi-tournament writes from self-play can be used.
+// Every few positions of a game are searched by Engine to the deepest
+// depth, and the values of its iterations give a sample of the values of
+// the position at every depth. For every stage of the game and pair of a
+// deep and a shallow depth, a line is then fitted to the deep values as
+// a function of the shallow ones by least squares, and sigma is the
+// standard deviation of the deep values from the line.
+//
+// The searches use the same evaluation as the game, so the parameters
+// have to be fitted again when the pattern weights change. They are
+// searched without selectivity, of course.
+
+#include <kaboutdata.h>
+#include <kcmdlineargs.h>
+#include <klocale.h>
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QFile>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+#include <cmath>
+
+#include "Engine.h"
+#include "Position.h"
+#include "ProbCut.h"
+
+// Least squares fit of a line y = slope * x + intercept.
+
+class LineFit
+{
+public:
+  LineFit() : m_n(0), m_x(0), m_y(0), m_xx(0), m_xy(0), m_yy(0) {}
+
+  void  add(double x, double y);
+  void  add(const LineFit& other);
+
+  int     samples() const { return m_n; }
+  double  slope() const;
+  double  intercept() const;
+  double  sigma() const;
+
+private:
+  int     m_n;
+  double  m_x, m_y, m_xx, m_xy, m_yy;    // sums
+};
+
+
+void LineFit::add(double x, double y)
+{
+  m_n++;
+  m_x  += x;
+  m_y  += y;
+  m_xx += x * x;
+  m_xy += x * y;
+  m_yy += y * y;
+}
+
+
+void LineFit::add(const LineFit& other)
+{
+  m_n  += other.m_n;
+  m_x  += other.m_x;
+  m_y  += other.m_y;
+  m_xx += other.m_xx;
+  m_xy += other.m_xy;
+  m_yy += other.m_yy;
+}
+
+
+double LineFit::slope() const
+{
+  double var_x = m_n * m_xx - m_x * m_x;
+  return var_x > 0 ? (m_n * m_xy - m_x * m_y) / var_x : 0;
+}
+
+
+double LineFit::intercept() const
+{
+  return m_n > 0 ? (m_y - slope() * m_x) / m_n : 0;
+}
+
+
+double LineFit::sigma() const
+{
+  if (m_n < 3)
+    return 0;
+
+  // The sum of the squared residuals, from the sums.
+  double a   = slope();
+  double b   = intercept();
+  double sse = m_yy - 2 * a * m_xy - 2 * b * m_y + a * a * m_xx
+    + 2 * a * b * m_x + m_n * b * b;
+
+  return std::sqrt(qMax(sse, 0.0) / (m_n - 2));
+}
+
+
+// The fits of all stages and pairs of depths, indexed by stage, deep
+// depth and shallow depth.
+
+class FitTable
+{
+public:
+  FitTable() : m_fits(ProbCut::NUMBER_OF_STAGES * SIZE * SIZE) {}
+
+  LineFit&        fit(int stage, int depth, int shallow_depth)
+  { return m_fits[(stage * SIZE + depth) * SIZE + shallow_depth]; }
+  const LineFit&  fit(int stage, int depth, int shallow_depth) const
+  { return m_fits[(stage * SIZE + depth) * SIZE + shallow_depth]; }
+
+  void  add(const FitTable& other)
+  {
+    for (int i = 0; i < m_fits.size(); i++)
+      m_fits[i].add(other.m_fits[i]);
+  }
+
+private:
+  static const int SIZE = ProbCut::MAX_DEPTH + 1;
+
+  QVector<LineFit>  m_fits;
+};
+
+
+// The shallow depth that goes with a deep depth: about half of it, with
+// the same parity, since the values of odd and even depths differ.
+static int shallowDepth(int depth)
+{
+  int shallow = depth / 2;
+  if ((depth - shallow) % 2 != 0)
+    shallow--;
+
+  return qMax(shallow, 1);
+}
+
+
+// A CalibrationThread searches the positions of games until there are
+// none left, and adds their values to its own fits.
+
+class CalibrationThread : public QThread
+{
+public:
+  CalibrationThread(const QVector<QString>* games, QAtomicInt* next_game,
+		    int depth, int every);
+
+  FitTable  m_fits;
+  int       m_positions;
+  int       m_skipped;     // games that are illegal
+
+protected:
+  void run();
+
+private:
+  bool  SearchGame(const QString& line);
+
+  const QVector<QString>*  m_games;
+  QAtomicInt*              m_next_game;
+  int                      m_depth;
+  int                      m_every;
+  Engine                   m_engine;
+};
+
+
+CalibrationThread::CalibrationThread(const QVector<QString>* games,
+				     QAtomicInt* next_game, int depth,
+				     int every)
+  : m_positions(0), m_skipped(0), m_games(games), m_next_game(next_game),
+    m_depth(depth), m_every(every), m_engine(depth)
+{
+}
+
+
+void CalibrationThread::run()
+{
+  for (;;) {
+    int game = m_next_game->fetchAndAddOrdered(1);
+    if (game >= m_games->size())
+      break;
+
+    if (!SearchGame((*m_games)[game]))
+      m_skipped++;
+  }
+}
+
+
+// Replay the game in line and search every m_every-th position in it.
+// Returns false if the game is illegal.
+
+bool CalibrationThread::SearchGame(const QString& line)
+{
+  Position position;
+  int      ply = 0;
+
+  for (int i = 0; i + 1 < line.size(); i += 2) {
+    if (position.legalMoves() == 0)
+      position.makeMove(0);    // pass
+
+    // The search goes deeper than asked for close to the end, and to the
+    // end of the game itself, so only earlier positions are searched.
+    int pieces = bitCount(position.bits(Black) | position.bits(White));
+    if (ply++ % m_every == 0 && pieces > 4 && pieces + m_depth + 5 < 64) {
+      m_engine.setGameState(position.gameStateString());
+      m_engine.searchMove();
+
+      QList<int> values = m_engine.iterationValues();
+      int        stage  = ProbCut::stage(pieces);
+      for (int depth = ProbCut::MIN_DEPTH; depth <= values.size(); depth++)
+	for (int shallow = 1; shallow < depth; shallow++)
+	  m_fits.fit(stage, depth, shallow).add(values[shallow - 1],
+						 values[depth - 1]);
+      m_positions++;
+    }
+
+    int col    = line[i].toLower().toLatin1() - 'a';
+    int row    = line[i + 1].toLatin1() - '1';
+    int square = row * 8 + col;
+    int index  = 0;
+    while (index < position.numberOfMoves()
+	   && position.moveSquare(index) != square)
+      index++;
+
+    if (col < 0 || col > 7 || row < 0 || row > 7
+	|| !position.makeMove(index))
+      return false;
+  }
+
+  return true;
+}
+
+
+int main(int argc, char **argv)
+{
+  // The application name is the one of the game, so that the searches
+  // find the pattern weights the game uses.
+  KAboutData aboutData("kreversi", 0, ki18n("KReversi ProbCut Calibration"),
+		       "1.0", ki18n("Fits the parameters of the KReversi selective search"),
+		       KAboutData::License_GPL);
+
+  KCmdLineArgs::init(argc, argv, &aboutData);
+
+  KCmdLineOptions options;
+  options.add("o");
+  options.add("output <file>", ki18n("Parameter file to write"), "probcut.bin");
+  options.add("d");
+  options.add("depth <number>", ki18n("Deepest depth to fit"), "10");
+  options.add("e");
+  options.add("every <number>", ki18n("Search every this many positions of a game"), "4");
+  options.add("m");
+  options.add("min-samples <number>", ki18n("Leave out pairs with fewer samples than this"), "50");
+  options.add("t");
+  options.add("threads <number>", ki18n("Number of threads, 0 for one per core"), "0");
+  options.add("+games", ki18n("Files with one game per line"));
+  KCmdLineArgs::addCmdLineOptions(options);
+
+  QCoreApplication app(KCmdLineArgs::qtArgc(), KCmdLineArgs::qtArgv());
+  KCmdLineArgs *args = KCmdLineArgs::parsedArgs();
+  QTextStream out(stdout);
+
+  int depth       = qBound(ProbCut::MIN_DEPTH, args->getOption("depth").toInt(),
+			   ProbCut::MAX_DEPTH);
+  int every       = qMax(args->getOption("every").toInt(), 1);
+  int min_samples = qMax(args->getOption("min-samples").toInt(), 3);
+  int threads     = args->getOption("threads").toInt();
+  if (threads <= 0)
+    threads = QThread::idealThreadCount();
+
+  // Read the games.
+  QVector<QString> games;
+  for (int i = 0; i < args->count(); i++) {
+    QFile file(args->arg(i));
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+      out << "cannot open " << args->arg(i) << endl;
+      return 1;
+    }
+
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+      QString line = in.readLine().trimmed();
+      if (!line.isEmpty() && !line.startsWith('#'))
+	games.append(line);
+    }
+  }
+
+  // Search them.
+  QAtomicInt next_game(0);
+  QList<CalibrationThread*> workers;
+  for (int i = 0; i < threads; i++) {
+    workers.append(new CalibrationThread(&games, &next_game, depth, every));
+    workers.last()->start();
+  }
+
+  FitTable fits;
+  int      positions = 0;
+  int      skipped   = 0;
+  for (int i = 0; i < workers.size(); i++) {
+    workers[i]->wait();
+    fits.add(workers[i]->m_fits);
+    positions += workers[i]->m_positions;
+    skipped   += workers[i]->m_skipped;
+  }
+  qDeleteAll(workers);
+
+  out << games.size() << " games, " << skipped << " games skipped, "
+      << positions << " positions searched" << endl;
+
+  // Every deep depth gets the pair with its shallow depth, and the one
+  // with a shallow depth 2 less, which is tried first since it is
+  // cheaper.
+  QVector<ProbCutPair> pairs;
+  for (int stage = 0; stage < ProbCut::NUMBER_OF_STAGES; stage++)
+    for (int d = ProbCut::MIN_DEPTH; d <= depth; d++)
+      for (int shallow = shallowDepth(d) - 2; shallow <= shallowDepth(d); shallow += 2) {
+	if (shallow < 1)
+	  continue;
+
+	const LineFit& fit = fits.fit(stage, d, shallow);
+	if (fit.samples() < min_samples || fit.slope() <= 0)
+	  continue;
+
+	ProbCutPair pair;
+	pair.m_stage         = stage;
+	pair.m_depth         = d;
+	pair.m_shallow_depth = shallow;
+	pair.m_slope         = fit.slope();
+	pair.m_intercept     = fit.intercept();
+	pair.m_sigma         = fit.sigma();
+	pairs.append(pair);
+
+	out << "stage " << stage << " depth " << d << "/" << shallow
+	    << ": " << fit.samples() << " samples, slope " << pair.m_slope
+	    << ", intercept " << pair.m_intercept << ", sigma " << pair.m_sigma
+	    << endl;
+      }
+
+  if (!ProbCut::save(args->getOption("output"), pairs)) {
+    out << "cannot write " << args->getOption("output") << endl;
+    return 1;
+  }
+
+  args->clear();
+  return 0;
+}
@@ -0,0 +1,394 @@
+// kreversi-tournament plays games between two AI profiles of
+// ai_profiles.lua, without the GUI and its animations, and reports how
+// they did against each other.
+//
+// The games are played by several threads at once. Each thread has its
+// own Ai for both profiles (and so its own Lua state and native
+// engines), and takes the next game to play from a shared counter until
+// all games are played. The profiles take turns to play Black.
+//
+// The engines and the Lua AI always start from the same seeds, so two
+// games from the same position would mostly repeat each other. Every
+// game therefore starts with a few random moves, drawn from its index.
+// The two games of a pair, in which the profiles swap colors, share
+// their opening, so that it favors neither profile.
+//
+// The report gives the wins, draws and losses of the first profile, its
+// Elo difference to the second one with a 95% confidence interval, and
+// for both profiles a histogram of the time they took per move. The
+// games can also be written to a file, one per line in the format that
+// kreversi-trainer reads.
+
+#include <kaboutdata.h>
+#include <kcmdlineargs.h>
+#include <klocale.h>
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+#include <cmath>
+
+#include "Engine.h"
+#include "Playout.h"
+#include "Position.h"
+#include "ai.h"
+
+// Move times are counted in buckets of powers of 2 milliseconds: bucket 0
+// holds moves of less than 1 ms, bucket b those of 2^(b-1) to 2^b - 1 ms,
+// and the last one all longer moves.
+static const int LATENCY_BUCKETS = 18;
+
+class MoveTimes
+{
+public:
+  MoveTimes() : m_moves(0), m_total(0), m_max(0)
+  {
+    for (int i = 0; i < LATENCY_BUCKETS; i++)
+      m_buckets[i] = 0;
+  }
+
+  void  add(int msecs);
+  void  add(const MoveTimes& other);
+
+  int     m_moves;
+  qint64  m_total;
+  int     m_max;
+  int     m_buckets[LATENCY_BUCKETS];
+};
+
+
+void MoveTimes::add(int msecs)
+{
+  int bucket = 0;
+  while (bucket < LATENCY_BUCKETS - 1 && (1 << bucket) <= msecs)
+    bucket++;
+
+  m_buckets[bucket]++;
+  m_moves++;
+  m_total += msecs;
+  m_max = qMax(m_max, msecs);
+}
+
+
+void MoveTimes::add(const MoveTimes& other)
+{
+  for (int i = 0; i < LATENCY_BUCKETS; i++)
+    m_buckets[i] += other.m_buckets[i];
+  m_moves += other.m_moves;
+  m_total += other.m_total;
+  m_max = qMax(m_max, other.m_max);
+}
+
+
+// A TournamentThread plays games until there are none left. Player 0 is
+// the first profile, player 1 the second.
+
+class TournamentThread : public QThread
+{
+public:
+  TournamentThread(const std::string& profile1, const std::string& profile2,
+		   int strength, int random_moves, QAtomicInt* next_game,
+		   int games, QVector<QString>* transcripts);
+  ~TournamentThread();
+
+  int  m_wins;      // of player 0
+  int  m_draws;
+  int  m_losses;
+  int  m_forfeits[2];
+  MoveTimes  m_times[2];
+
+protected:
+  void run();
+
+private:
+  void  PlayGame(int game);
+
+  Ai*      m_ai[2];
+  Engine*  m_engine[2];
+  int      m_random_moves;
+
+  QAtomicInt*        m_next_game;
+  int                m_games;
+  QVector<QString>*  m_transcripts;  // indexed by game, 0 if not wanted
+};
+
+
+TournamentThread::TournamentThread(const std::string& profile1,
+				   const std::string& profile2,
+				   int strength, int random_moves,
+				   QAtomicInt* next_game, int games,
+				   QVector<QString>* transcripts)
+  : m_wins(0), m_draws(0), m_losses(0), m_random_moves(random_moves),
+    m_next_game(next_game), m_games(games), m_transcripts(transcripts)
+{
+  m_forfeits[0] = m_forfeits[1] = 0;
+
+  // The profiles are located and loaded here, in the main thread.
+  m_ai[0] = new Ai(profile1);
+  m_ai[1] = new Ai(profile2);
+
+  // Every player keeps its engine for all its moves, like the game does,
+  // so that the transposition table is not allocated for every move.
+  for (int player = 0; player < 2; player++)
+    m_engine[player] = new Engine(strength);
+}
+
+
+TournamentThread::~TournamentThread()
+{
+  for (int player = 0; player < 2; player++) {
+    delete m_ai[player];
+    delete m_engine[player];
+  }
+}
+
+
+void TournamentThread::run()
+{
+  for (;;) {
+    int game = m_next_game->fetchAndAddOrdered(1);
+    if (game >= m_games)
+      break;
+
+    PlayGame(game);
+  }
+}
+
+
+void TournamentThread::PlayGame(int game)
+{
+  // Player 0 is Black in the even games.
+  int       black = game % 2;
+  Position  position;
+  QString   transcript;
+  int       forfeit = -1;
+
+  // The random opening of the pair of games.  The state of the generator
+  // must not be 0.
+  quint64 random = Q_UINT64_C(0x9E3779B97F4A7C15) * (game / 2 + 1);
+  for (int i = 0; i < m_random_moves && position.legalMoves() != 0; i++) {
+    int index  = nextRandom(random) % position.numberOfMoves();
+    int square = position.moveSquare(index);
+
+    position.makeMove(index);
+    transcript += QChar('a' + square % 8);
+    transcript += QChar('1' + square / 8);
+  }
+
+  while (!position.gameOver()) {
+    if (position.legalMoves() == 0) {
+      position.makeMove(0);    // pass
+      continue;
+    }
+
+    int     player = (position.turn() == Black) == (black == 0) ? 0 : 1;
+    Engine* engine = m_engine[player];
+    engine->setGameState(position.gameStateString());
+
+    QElapsedTimer timer;
+    timer.start();
+    KReversiPos move = m_ai[player]->selectMove(*engine);
+    m_times[player].add(timer.elapsed());
+
+    // Find the index of the move. A player that does not come up with a
+    // legal move loses the game.
+    int square = move.row * 8 + move.col;
+    int index  = 0;
+    while (index < position.numberOfMoves()
+	   && position.moveSquare(index) != square)
+      index++;
+
+    if (move.row < 0 || move.col < 0 || index == position.numberOfMoves()) {
+      forfeit = player;
+      break;
+    }
+
+    position.makeMove(index);
+    transcript += QChar('a' + move.col);
+    transcript += QChar('1' + move.row);
+  }
+
+  int winner;    // player, or -1 for a draw
+  if (forfeit >= 0) {
+    winner = 1 - forfeit;
+    m_forfeits[forfeit]++;
+  }
+  else if (position.leader() == NoColor)
+    winner = -1;
+  else
+    winner = (position.leader() == Black) == (black == 0) ? 0 : 1;
+
+  if (winner == 0)
+    m_wins++;
+  else if (winner == 1)
+    m_losses++;
+  else
+    m_draws++;
+
+  if (m_transcripts && forfeit < 0)
+    (*m_transcripts)[game] = transcript;
+}
+
+
+// The Elo difference that makes a player expect the given score, between
+// 0 and 1, against its opponent.
+static double eloDifference(double score)
+{
+  score = qBound(0.001, score, 0.999);
+  return -400.0 * std::log10(1.0 / score - 1.0);
+}
+
+
+static void printTimes(QTextStream& out, const QString& profile,
+		       const MoveTimes& times)
+{
+  out << endl << "move times of " << profile << ": " << times.m_moves
+      << " moves, average "
+      << (times.m_moves ? double(times.m_total) / times.m_moves : 0.0)
+      << " ms, longest " << times.m_max << " ms" << endl;
+
+  int most = 1;
+  for (int i = 0; i < LATENCY_BUCKETS; i++)
+    most = qMax(most, times.m_buckets[i]);
+
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    if (times.m_buckets[i] == 0)
+      continue;
+
+    QString range;
+    if (i == 0)
+      range = "< 1";
+    else if (i == 1)
+      range = "1";
+    else if (i == LATENCY_BUCKETS - 1)
+      range = QString(">= %1").arg(1 << (i - 1));
+    else
+      range = QString("%1-%2").arg(1 << (i - 1)).arg((1 << i) - 1);
+
+    out << qSetFieldWidth(14) << right << range << qSetFieldWidth(0)
+	<< " ms " << qSetFieldWidth(7) << times.m_buckets[i] << qSetFieldWidth(0)
+	<< " " << QString(50 * times.m_buckets[i] / most, '#') << endl;
+  }
+}
+
+
+int main(int argc, char **argv)
+{
+  // The application name is the one of the game, so that the profiles
+  // and the Lua AI are found among its data files.
+  KAboutData aboutData("kreversi", 0, ki18n("KReversi Tournament"),
+		       "1.0", ki18n("Plays games between two KReversi AI profiles"),
+		       KAboutData::License_GPL);
+
+  KCmdLineArgs::init(argc, argv, &aboutData);
+
+  KCmdLineOptions options;
+  options.add("n");
+  options.add("games <number>", ki18n("Number of games to play"), "100");
+  options.add("t");
+  options.add("threads <number>", ki18n("Number of games played at once, 0 for one per core"), "0");
+  options.add("s");
+  options.add("strength <level>", ki18n("Skill level of native searches without a time limit, 1 to 7"), "4");
+  options.add("r");
+  options.add("random-moves <number>", ki18n("Number of random moves every game starts with"), "6");
+  options.add("o");
+  options.add("output <file>", ki18n("Write the moves of the games to file, one game per line"));
+  options.add("+profile1", ki18n("First AI profile"));
+  options.add("+profile2", ki18n("Second AI profile"));
+  KCmdLineArgs::addCmdLineOptions(options);
+
+  QCoreApplication app(KCmdLineArgs::qtArgc(), KCmdLineArgs::qtArgv());
+  KCmdLineArgs *args = KCmdLineArgs::parsedArgs();
+  QTextStream out(stdout);
+
+  if (args->count() != 2)
+    KCmdLineArgs::usageError(i18n("Two AI profiles are needed."));
+
+  QString  profile1 = args->arg(0);
+  QString  profile2 = args->arg(1);
+  int      games    = qMax(args->getOption("games").toInt(), 1);
+  int      threads  = args->getOption("threads").toInt();
+  int      strength = qBound(1, args->getOption("strength").toInt(), 7);
+  int      random_moves = qBound(0, args->getOption("random-moves").toInt(), 20);
+  if (threads <= 0)
+    threads = QThread::idealThreadCount();
+  threads = qMin(threads, games);
+
+  QVector<QString>  transcripts;
+  bool              write_games = args->isSet("output");
+  if (write_games)
+    transcripts.resize(games);
+
+  QAtomicInt next_game(0);
+  QList<TournamentThread*> workers;
+  for (int i = 0; i < threads; i++)
+    workers.append(new TournamentThread(profile1.toStdString(),
+					profile2.toStdString(), strength,
+					random_moves, &next_game, games,
+					write_games ? &transcripts : 0));
+
+  QElapsedTimer timer;
+  timer.start();
+  for (int i = 0; i < workers.size(); i++)
+    workers[i]->start();
+
+  int        wins = 0;
+  int        draws = 0;
+  int        losses = 0;
+  int        forfeits[2] = { 0, 0 };
+  MoveTimes  times[2];
+  for (int i = 0; i < workers.size(); i++) {
+    workers[i]->wait();
+    wins   += workers[i]->m_wins;
+    draws  += workers[i]->m_draws;
+    losses += workers[i]->m_losses;
+    for (int player = 0; player < 2; player++) {
+      forfeits[player] += workers[i]->m_forfeits[player];
+      times[player].add(workers[i]->m_times[player]);
+    }
+  }
+  qDeleteAll(workers);
+
+  // The score of the first profile per game, and its standard error,
+  // from the spread of the results.
+  double score    = (wins + 0.5 * draws) / games;
+  double variance = (wins * (1 - score) * (1 - score)
+		     + draws * (0.5 - score) * (0.5 - score)
+		     + losses * score * score) / games;
+  double error    = std::sqrt(variance / games);
+
+  out << profile1 << " - " << profile2 << ": " << games << " games in "
+      << timer.elapsed() / 1000.0 << " s" << endl;
+  out << "wins " << wins << ", draws " << draws << ", losses " << losses
+      << ", score " << 100 * score << "%" << endl;
+  if (forfeits[0] + forfeits[1] > 0)
+    out << "forfeits (no legal move returned): " << forfeits[0] << " - "
+	<< forfeits[1] << endl;
+  out << "elo difference " << qRound(eloDifference(score))
+      << " (95% interval " << qRound(eloDifference(score - 1.96 * error))
+      << " to " << qRound(eloDifference(score + 1.96 * error)) << ")" << endl;
+
+  printTimes(out, profile1, times[0]);
+  printTimes(out, profile2, times[1]);
+
+  if (write_games) {
+    QFile file(args->getOption("output"));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+      out << "cannot write " << args->getOption("output") << endl;
+      return 1;
+    }
+
+    QTextStream games_out(&file);
+    games_out << "# " << profile1 << " - " << profile2 << endl;
+    for (int game = 0; game < transcripts.size(); game++)
+      if (!transcripts[game].isEmpty())
+	games_out << transcripts[game] << endl;
+  }
+
+  args->clear();
+  return 0;
+}
@@ -0,0 +1,314 @@
+// kreversi-trainer fits the weights of the pattern evaluation (see
+// PatternEval.h) to the results of a collection of games, and writes
+// them to a weight file that Engine maps at startup.
+//
+// The games are read from text files with one game per line, written as
+// the squares of the moves in the usual notation, for example
+// "f5d6c3d3c4...". Passes are not written, they are implied by a side
+// having no legal move. Empty lines and lines starting with '#' are
+// skipped, and so are games that are illegal or do not reach the end.
+//
+// Every position of a game becomes a sample whose target is the final
+// piece difference (Black minus White) of the game. The weights are
+// fitted by least squares: each epoch computes the error of every
+// sample, and moves every weight by the sum of the errors of the
+// samples it occurs in, divided by the number of those samples. Since
+// only about 40 of the weights of a stage occur in a sample, this is
+// cheap even for millions of samples. The samples are split between
+// several threads, each adding up its own part of the sums.
+//
+// Samples are also used for the two neighbouring stages, so that the
+// weights do not change too abruptly from one stage to the next, and
+// stages with few samples still get reasonable weights.
+
+#include <kaboutdata.h>
+#include <kcmdlineargs.h>
+#include <klocale.h>
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+#include <cmath>
+
+#include "Bitboard.h"
+#include "PatternEval.h"
+
+static const int NUMBER_OF_WEIGHTS =
+  PatternEval::NUMBER_OF_STAGES * PatternEval::WEIGHTS_PER_STAGE;
+
+// Position of the table of each feature within a stage.
+static int s_table[PatternFeatures::NUMBER_OF_FEATURES];
+
+// A position of a game, reduced to what the evaluation looks at.
+
+class TrainingSample
+{
+public:
+  quint16  m_index[PatternFeatures::NUMBER_OF_FEATURES];
+  qint8    m_mobility;     // difference between Black and White
+  qint8    m_potential;    // the same for the potential mobility
+  qint8    m_stage;
+  qint8    m_result;       // final piece difference
+};
+
+
+// Replay the game in line and add a sample for every position that is
+// not the end of the game. Returns false if the game is illegal or does
+// not reach the end, and then adds nothing.
+
+static bool addGame(const QString& line, QVector<TrainingSample>& samples)
+{
+  quint64 bits[2];
+  bits[White] = squareBit(27) | squareBit(36);
+  bits[Black] = squareBit(28) | squareBit(35);
+
+  ChipColor turn = Black;
+  QVector<TrainingSample> game;
+
+  for (int i = 0; i + 1 < line.size(); i += 2) {
+    int col = line[i].toLower().toLatin1() - 'a';
+    int row = line[i + 1].toLatin1() - '1';
+    if (col < 0 || col > 7 || row < 0 || row > 7)
+      return false;
+
+    ChipColor opponent = turn == Black ? White : Black;
+    if (legalMoveBits(bits[turn], bits[opponent]) == 0)
+      qSwap(turn, opponent);
+
+    int     square  = row * 8 + col;
+    quint64 flipped = 0;
+    if (!(bits[turn] & squareBit(square)) && !(bits[opponent] & squareBit(square)))
+      flipped = flippedBits(square, bits[turn], bits[opponent]);
+    if (flipped == 0)
+      return false;
+
+    bits[turn]     |= flipped | squareBit(square);
+    bits[opponent] &= ~flipped;
+    turn = opponent;
+
+    if (legalMoveBits(bits[White], bits[Black]) == 0
+	&& legalMoveBits(bits[Black], bits[White]) == 0)
+      break;
+
+    PatternFeatures features;
+    features.setup(bits[Black], bits[White]);
+
+    quint64 empty = ~(bits[Black] | bits[White]);
+    TrainingSample sample;
+    for (int f = 0; f < PatternFeatures::NUMBER_OF_FEATURES; f++)
+      sample.m_index[f] = features.index(f);
+    sample.m_mobility  = bitCount(legalMoveBits(bits[Black], bits[White]))
+      - bitCount(legalMoveBits(bits[White], bits[Black]));
+    sample.m_potential = bitCount(adjacentBits(bits[White]) & empty)
+      - bitCount(adjacentBits(bits[Black]) & empty);
+    sample.m_stage     = PatternEval::stage(bitCount(bits[Black] | bits[White]));
+    game.append(sample);
+  }
+
+  if (legalMoveBits(bits[White], bits[Black]) != 0
+      || legalMoveBits(bits[Black], bits[White]) != 0)
+    return false;
+
+  int result = bitCount(bits[Black]) - bitCount(bits[White]);
+  for (int i = 0; i < game.size(); i++) {
+    game[i].m_result = result;
+    samples.append(game[i]);
+  }
+
+  return true;
+}
+
+
+// A TrainerThread adds up the errors of a range of the samples for every
+// weight, and the squared errors of the samples in their own stage.
+
+class TrainerThread : public QThread
+{
+public:
+  TrainerThread(const QVector<TrainingSample>& samples, int begin, int end,
+		const float* weights)
+    : m_samples(samples), m_begin(begin), m_end(end), m_weights(weights),
+      m_errors(NUMBER_OF_WEIGHTS), m_squared_error(0) {}
+
+  const QVector<float>&  errors() const  { return m_errors; }
+  double  squaredError() const           { return m_squared_error; }
+
+protected:
+  void run();
+
+private:
+  const QVector<TrainingSample>&  m_samples;
+  int              m_begin;
+  int              m_end;
+  const float*     m_weights;
+  QVector<float>   m_errors;
+  double           m_squared_error;
+};
+
+
+void TrainerThread::run()
+{
+  m_errors.fill(0);
+  m_squared_error = 0;
+
+  for (int i = m_begin; i < m_end; i++) {
+    const TrainingSample& sample = m_samples[i];
+
+    int first = qMax(sample.m_stage - 1, 0);
+    int last  = qMin(sample.m_stage + 1, PatternEval::NUMBER_OF_STAGES - 1);
+
+    for (int stage = first; stage <= last; stage++) {
+      const float* weights = m_weights + stage * PatternEval::WEIGHTS_PER_STAGE;
+      float*       errors  = m_errors.data() + stage * PatternEval::WEIGHTS_PER_STAGE;
+
+      float value = weights[PatternEval::MOBILITY_WEIGHT] * sample.m_mobility
+	+ weights[PatternEval::POTENTIAL_MOBILITY_WEIGHT] * sample.m_potential;
+      for (int f = 0; f < PatternFeatures::NUMBER_OF_FEATURES; f++)
+	value += weights[s_table[f] + sample.m_index[f]];
+
+      float error = 100.0 * sample.m_result - value;
+      if (stage == sample.m_stage)
+	m_squared_error += double(error) * error;
+
+      errors[PatternEval::MOBILITY_WEIGHT]           += error * sample.m_mobility;
+      errors[PatternEval::POTENTIAL_MOBILITY_WEIGHT] += error * sample.m_potential;
+      for (int f = 0; f < PatternFeatures::NUMBER_OF_FEATURES; f++)
+	errors[s_table[f] + sample.m_index[f]] += error;
+    }
+  }
+}
+
+
+int main(int argc, char **argv)
+{
+  KAboutData aboutData("kreversi-trainer", "kreversi", ki18n("KReversi Trainer"),
+		       "1.0", ki18n("Fits the weights of the KReversi pattern evaluation to a collection of games"),
+		       KAboutData::License_GPL);
+
+  KCmdLineArgs::init(argc, argv, &aboutData);
+
+  KCmdLineOptions options;
+  options.add("o");
+  options.add("output <file>", ki18n("Weight file to write"), "pattern_weights.bin");
+  options.add("e");
+  options.add("epochs <number>", ki18n("Number of passes over the samples"), "100");
+  options.add("r");
+  options.add("rate <rate>", ki18n("Fraction of the error corrected in each pass"), "0.02");
+  options.add("t");
+  options.add("threads <number>", ki18n("Number of threads, 0 for one per core"), "0");
+  options.add("+games", ki18n("Files with one game per line"));
+  KCmdLineArgs::addCmdLineOptions(options);
+
+  QCoreApplication app(KCmdLineArgs::qtArgc(), KCmdLineArgs::qtArgv());
+  KCmdLineArgs *args = KCmdLineArgs::parsedArgs();
+  QTextStream out(stdout);
+
+  int     epochs  = args->getOption("epochs").toInt();
+  double  rate    = args->getOption("rate").toDouble();
+  int     threads = args->getOption("threads").toInt();
+  if (threads <= 0)
+    threads = QThread::idealThreadCount();
+
+  for (int f = 0; f < PatternFeatures::NUMBER_OF_FEATURES; f++)
+    s_table[f] = PatternEval::weightIndex(f, 0);
+
+  // Read the games.
+  QVector<TrainingSample> samples;
+  int games   = 0;
+  int skipped = 0;
+
+  for (int i = 0; i < args->count(); i++) {
+    QFile file(args->arg(i));
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+      out << "cannot open " << args->arg(i) << endl;
+      return 1;
+    }
+
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+      QString line = in.readLine().trimmed();
+      if (line.isEmpty() || line.startsWith('#'))
+	continue;
+
+      if (addGame(line, samples))
+	games++;
+      else
+	skipped++;
+    }
+  }
+
+  out << games << " games, " << samples.size() << " positions, "
+      << skipped << " games skipped" << endl;
+  if (samples.isEmpty())
+    return 1;
+
+  // The number of samples each weight occurs in, or for the mobility
+  // weights the sum of the squares of their features, counted for each
+  // stage the samples are used for.
+  QVector<float> counts(NUMBER_OF_WEIGHTS, 0);
+  for (int i = 0; i < samples.size(); i++) {
+    const TrainingSample& sample = samples[i];
+
+    int first = qMax(sample.m_stage - 1, 0);
+    int last  = qMin(sample.m_stage + 1, PatternEval::NUMBER_OF_STAGES - 1);
+
+    for (int stage = first; stage <= last; stage++) {
+      float* stage_counts = counts.data() + stage * PatternEval::WEIGHTS_PER_STAGE;
+
+      stage_counts[PatternEval::MOBILITY_WEIGHT] += sample.m_mobility * sample.m_mobility;
+      stage_counts[PatternEval::POTENTIAL_MOBILITY_WEIGHT] += sample.m_potential * sample.m_potential;
+      for (int f = 0; f < PatternFeatures::NUMBER_OF_FEATURES; f++)
+	stage_counts[s_table[f] + sample.m_index[f]] += 1;
+    }
+  }
+
+  QVector<float> weights(NUMBER_OF_WEIGHTS, 0);
+
+  QList<TrainerThread*> workers;
+  for (int i = 0; i < threads; i++)
+    workers.append(new TrainerThread(samples,
+				     qint64(samples.size()) * i / threads,
+				     qint64(samples.size()) * (i + 1) / threads,
+				     weights.constData()));
+
+  for (int epoch = 1; epoch <= epochs; epoch++) {
+    for (int i = 0; i < workers.size(); i++)
+      workers[i]->start();
+
+    double squared_error = 0;
+    for (int i = 0; i < workers.size(); i++) {
+      workers[i]->wait();
+      squared_error += workers[i]->squaredError();
+    }
+
+    for (int w = 0; w < NUMBER_OF_WEIGHTS; w++) {
+      if (counts[w] == 0)
+	continue;
+
+      float error = 0;
+      for (int i = 0; i < workers.size(); i++)
+	error += workers[i]->errors()[w];
+      weights[w] += rate * error / counts[w];
+    }
+
+    // Squared errors are in hundredths of pieces.
+    out << "epoch " << epoch << " rms error "
+	<< std::sqrt(squared_error / samples.size()) / 100 << endl;
+  }
+
+  qDeleteAll(workers);
+
+  QVector<qint16> result(NUMBER_OF_WEIGHTS);
+  for (int w = 0; w < NUMBER_OF_WEIGHTS; w++)
+    result[w] = qint16(qBound(-32767.0, std::floor(weights[w] + 0.5), 32767.0));
+
+  if (!PatternEval::save(args->getOption("output"), result.constData())) {
+    out << "cannot write " << args->getOption("output") << endl;
+    return 1;
+  }
+
+  args->clear();
+  return 0;
+}